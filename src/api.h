@@ -9,12 +9,12 @@
 #include <inttypes.h>
 #include <json-c/json.h>
 #include <stdbool.h>
+#include <strings.h>
 
 #define MAX_HEADER_LENGTH               256
 #define MAX_HEADER_NAME_LENGTH          128
 #define MAX_HEADER_VALUE_LENGTH         512
 #define MAX_URL_LENGTH                  2048
-#define MAX_BODY_SIZE                   16384
 
 #define CONTENT_TYPE_XML            "application/xml"
 #define CONTENT_TYPE_JSON           "application/json"
@@ -50,6 +50,8 @@ struct http_response {
     char *body;
     size_t body_length;
     struct http_header **headers;
+    struct json_tokener *tokener; // set for the responses parsed while they arrive
+    json_object *json;
 };
 
 typedef enum http_request_types {
@@ -76,6 +78,27 @@ struct http_request {
     struct http_header **headers;
 };
 
+/*
+ * Appends the artists of the track to the string, separated by VALUE_SEPARATOR
+ */
+char *api_append_artists(char *result, const struct scrobble *track)
+{
+    if (NULL == result) { return result; }
+
+    bool first = true;
+    for (size_t i = 0; i < scrobble_count(track, scrobble_field_artist); i++) {
+        const char *artist = scrobble_artist(track, i);
+        if (strlen(artist) == 0) { continue; }
+
+        if (!first) {
+            result = grrrs_append_cstring(result, VALUE_SEPARATOR);
+        }
+        result = grrrs_append_cstring(result, artist);
+        first = false;
+    }
+    return result;
+}
+
 #include "audioscrobbler_api.h"
 #include "listenbrainz_api.h"
 
@@ -95,38 +118,40 @@ char *http_response_headers_content_type(struct http_response *res)
     return NULL;
 }
 
-#if 0
-static void http_response_parse_json_body(struct http_response *res)
+/*
+ * The body of the response is parsed as the chunks arrive, so the document is ready when the
+ * transfer ends, without going over the body a second time
+ */
+void http_response_expect_json(struct http_response *res)
 {
     if (NULL == res) { return; }
-    if (res->code >= 500) { return; }
+    if (NULL != res->tokener) { return; }
 
-    json_object *obj = json_tokener_parse(res->body);
-    if (NULL == obj) {
-        _warn("json::parse_error");
-    }
-    if (json_object_array_length(obj) < 1) {
-        _warn("json::invalid_json_message");
-    }
-    _trace("json::obj_cnt: %d", json_object_array_length(obj));
-#if 0
-    if (json_object_type(object, json_type_object)) {
-        json_object_object_get_ex();
+    res->tokener = json_tokener_new();
+}
+
+void http_response_parse_json_body(struct http_response *res, const char *chunk, size_t length)
+{
+    if (NULL == res->tokener) { return; }
+    if (NULL != res->json) { return; }
+
+    enum json_tokener_error err = json_tokener_get_error(res->tokener);
+    if (err != json_tokener_success && err != json_tokener_continue) { return; }
+
+    res->json = json_tokener_parse_ex(res->tokener, chunk, (int)length);
+    err = json_tokener_get_error(res->tokener);
+    if (NULL == res->json && err != json_tokener_continue) {
+        _warn("json::parse_error: %s", json_tokener_error_desc(err));
     }
-#endif
 }
-#endif
 
 char *api_get_url(struct api_endpoint *endpoint)
 {
     if (NULL == endpoint) { return NULL; }
-    char *url = get_zero_string(MAX_URL_LENGTH);
-    if (NULL == url) { return NULL; }
-
-    strncat(url, endpoint->scheme, MAX_URL_LENGTH);
-    strncat(url, "://", 4);
-    strncat(url, endpoint->host, MAX_URL_LENGTH);
-    strncat(url, endpoint->path, MAX_URL_LENGTH);
+    char *url = grrrs_from_string(endpoint->scheme);
+    url = grrrs_append(url, "://", 3);
+    url = grrrs_append_cstring(url, endpoint->host);
+    url = grrrs_append_cstring(url, endpoint->path);
 
     return url;
 }
@@ -134,18 +159,14 @@ char *api_get_url(struct api_endpoint *endpoint)
 char *http_request_get_url(const struct http_request *request)
 {
     if (NULL == request) { return NULL; }
-    char *url = get_zero_string(MAX_URL_LENGTH);
-    if (NULL == url) { return NULL; }
-
-    strncat(url, request->url, MAX_URL_LENGTH);
+    char *url = grrrs_from_string(request->url);
     if (NULL == request->query) {
         goto _return;
     }
 
-    size_t query_len = strlen(request->query);
-    if (query_len > 0) {
-        strncat(url, "?", 2);
-        strncat(url, request->query, query_len + 1);
+    if (strlen(request->query) > 0) {
+        url = grrrs_append(url, "?", 1);
+        url = grrrs_append_cstring(url, request->query);
     }
 
 _return:
@@ -516,6 +537,24 @@ const char *api_get_application_key(enum api_type type)
     return NULL;
 }
 
+/*
+ * The largest number of tracks the service accepts in a single scrobble request
+ */
+int api_get_max_batch_size(enum api_type type)
+{
+    switch (type) {
+        case api_librefm:
+        case api_lastfm:
+            return API_MAX_SCROBBLES_PER_REQUEST;
+        case api_listenbrainz:
+            return API_MAX_LISTENS_PER_REQUEST;
+        case api_unknown:
+        default:
+            return 1;
+    }
+    return 1;
+}
+
 char *api_get_auth_url(struct api_credentials *credentials)
 {
     if (NULL == credentials) { return NULL; }
@@ -650,9 +689,16 @@ void http_response_clean(struct http_response *res)
     if (NULL == res) { return; }
 
     if (NULL != res->body) {
-        memset(res->body, 0, MAX_BODY_SIZE);
+        grrrs_clear(res->body);
         res->body_length = 0;
     }
+    if (NULL != res->json) {
+        json_object_put(res->json);
+        res->json = NULL;
+    }
+    if (NULL != res->tokener) {
+        json_tokener_reset(res->tokener);
+    }
     http_headers_free(res->headers);
     res->headers = NULL;
 }
@@ -666,6 +712,8 @@ void http_response_free(struct http_response *res)
         res->body = NULL;
         res->body_length = 0;
     }
+    if (NULL != res->json) { json_object_put(res->json); }
+    if (NULL != res->tokener) { json_tokener_free(res->tokener); }
     http_headers_free(res->headers);
     free(res);
 }
@@ -720,11 +768,17 @@ struct http_response *http_response_new(void)
 {
     struct http_response *res = malloc(sizeof(struct http_response));
 
-    res->body = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == res->body) { return NULL; }
+    // the body starts empty, and grows with the response
+    res->body = get_zero_string(0);
+    if (NULL == res->body) {
+        free(res);
+        return NULL;
+    }
     res->code = -1;
     res->body_length = 0;
     res->headers = NULL;
+    res->tokener = NULL;
+    res->json = NULL;
 
     return res;
 }
@@ -747,15 +801,33 @@ void http_header_load(const char *data, size_t length, struct http_header *h)
     strncpy(h->value, scol_pos + 2, value_length - 2); // skip : and space
 }
 
-bool json_document_is_error(const char *buffer, const size_t length, enum api_type type)
+/*
+ * Returns the value of the first response header with the name, HTTP/2 sends all of them in lower case
+ */
+const char *http_response_get_header(const struct http_response *res, const char *name)
+{
+    if (NULL == res || NULL == name) { return NULL; }
+
+    int headers_count = arrlen(res->headers);
+    for (int i = 0; i < headers_count; i++) {
+        struct http_header *h = res->headers[i];
+        if (NULL == h) { continue; }
+        if (strcasecmp(h->name, name) == 0) {
+            return h->value;
+        }
+    }
+    return NULL;
+}
+
+bool json_document_is_error(const json_object *root, enum api_type type)
 {
     switch (type) {
         case api_lastfm:
         case api_librefm:
-            return audioscrobbler_json_document_is_error(buffer, length);
+            return audioscrobbler_json_document_is_error(root);
             break;
         case api_listenbrainz:
-            return listenbrainz_json_document_is_error(buffer, length);
+            return listenbrainz_json_document_is_error(root);
             break;
         case api_unknown:
         default:
@@ -764,12 +836,12 @@ bool json_document_is_error(const char *buffer, const size_t length, enum api_ty
     return false;
 }
 
-void api_response_get_token_json(const char *buffer, const size_t length, struct api_credentials *credentials)
+void api_response_get_token_json(json_object *root, struct api_credentials *credentials)
 {
     switch (credentials->end_point) {
         case api_lastfm:
         case api_librefm:
-            audioscrobbler_api_response_get_token_json(buffer, length, credentials);
+            audioscrobbler_api_response_get_token_json(root, credentials);
             break;
         case api_listenbrainz:
         case api_unknown:
@@ -778,12 +850,12 @@ void api_response_get_token_json(const char *buffer, const size_t length, struct
     }
 }
 
-void api_response_get_session_key_json(const char *buffer, const size_t length, struct api_credentials *credentials)
+void api_response_get_session_key_json(json_object *root, struct api_credentials *credentials)
 {
     switch (credentials->end_point) {
         case api_lastfm:
         case api_librefm:
-            audioscrobbler_api_response_get_session_key_json(buffer, length, credentials);
+            audioscrobbler_api_response_get_session_key_json(root, credentials);
             break;
         case api_listenbrainz:
         case api_unknown:
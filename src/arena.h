@@ -0,0 +1,75 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+#ifndef MPRIS_SCROBBLER_ARENA_H
+#define MPRIS_SCROBBLER_ARENA_H
+
+#define ARENA_CHUNK_SIZE 1024
+
+static struct arena_chunk *arena_chunk_new(size_t capacity)
+{
+    struct arena_chunk *chunk = malloc(sizeof(struct arena_chunk) + capacity);
+    if (NULL == chunk) { return NULL; }
+
+    chunk->next = NULL;
+    chunk->length = 0;
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+char *arena_alloc(struct arena *a, size_t size)
+{
+    assert(NULL != a);
+
+    struct arena_chunk *chunk = a->chunks;
+    if (NULL == chunk || chunk->capacity - chunk->length < size) {
+        chunk = arena_chunk_new(size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+        if (NULL == chunk) { return NULL; }
+        chunk->next = a->chunks;
+        a->chunks = chunk;
+        _trace2("mem::arena(%p):new_chunk(%p) %zu", a, chunk, chunk->capacity);
+    }
+    char *result = chunk->data + chunk->length;
+    chunk->length += size;
+    return result;
+}
+
+const char *arena_strdup(struct arena *a, const char *value)
+{
+    if (NULL == value) { return NULL; }
+
+    size_t len = strlen(value) + 1;
+    char *result = arena_alloc(a, len);
+    if (NULL == result) { return NULL; }
+
+    memcpy(result, value, len);
+    return result;
+}
+
+/*
+ * Drops all values, keeping only the newest chunk around for reuse
+ */
+void arena_reset(struct arena *a)
+{
+    if (NULL == a || NULL == a->chunks) { return; }
+
+    struct arena_chunk *chunk = a->chunks->next;
+    while (NULL != chunk) {
+        struct arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    a->chunks->next = NULL;
+    a->chunks->length = 0;
+}
+
+void arena_free(struct arena *a)
+{
+    if (NULL == a) { return; }
+
+    arena_reset(a);
+    free(a->chunks);
+    a->chunks = NULL;
+}
+
+#endif // MPRIS_SCROBBLER_ARENA_H
@@ -11,7 +11,11 @@
 #include "credentials_librefm.h"
 #endif
 
+#include "stb_ds.h"
+
 #define MIN_SCROBBLE_MINUTES        4
+#define API_MAX_SCROBBLES_PER_REQUEST   50
+#define API_PARAM_NAME_LENGTH           32
 
 #define LASTFM_AUTH_URL            "www.last.fm"
 #define LASTFM_AUTH_PATH           "api/auth/?api_key=%s&token=%s"
@@ -99,39 +103,33 @@ struct api_error {
     char *message;
 };
 
-void audioscrobbler_api_response_get_session_key_json(const char *buffer, const size_t length, struct api_credentials *credentials)
+void audioscrobbler_api_response_get_session_key_json(json_object *root, struct api_credentials *credentials)
 {
-    if (NULL == buffer) { return; }
-    if (length == 0) { return; }
-
-    struct json_tokener *tokener = json_tokener_new();
-    if (NULL == tokener) { return; }
-    json_object *root = json_tokener_parse_ex(tokener, buffer, length);
     if (NULL == root) {
         _warn("json::invalid_json_message");
-        goto _exit;
+        return;
     }
     if (json_object_object_length(root) < 1) {
         _warn("json::no_root_object");
-        goto _exit;
+        return;
     }
     json_object *sess_object = NULL;
     if (!json_object_object_get_ex(root, API_SESSION_NODE_NAME, &sess_object) || NULL == sess_object) {
         _warn("json:missing_session_object");
-        goto _exit;
+        return;
     }
     if (!json_object_is_type(sess_object, json_type_object)) {
         _warn("json::session_is_not_object");
-        goto _exit;
+        return;
     }
     json_object *key_object = NULL;
     if (!json_object_object_get_ex(sess_object, API_KEY_NODE_NAME, &key_object) || NULL == key_object) {
         _warn("json:missing_key");
-        goto _exit;
+        return;
     }
     if (!json_object_is_type(key_object, json_type_string)) {
         _warn("json::key_is_not_string");
-        goto _exit;
+        return;
     }
     const char *session_key = json_object_get_string(key_object);
     memcpy((char*)credentials->session_key, session_key, strlen(session_key));
@@ -139,86 +137,58 @@ void audioscrobbler_api_response_get_session_key_json(const char *buffer, const
 
     json_object *name_object = NULL;
     if (!json_object_object_get_ex(sess_object, API_NAME_NODE_NAME, &name_object) || NULL == name_object) {
-        goto _exit;
+        return;
     }
     if (!json_object_is_type(name_object, json_type_string)) {
-        goto _exit;
+        return;
     }
     const char *name = json_object_get_string(name_object);
     strncpy((char*)credentials->user_name, name, MAX_PROPERTY_LENGTH);
     _info("json::loaded_session_user: %s", name);
-
-_exit:
-    if (NULL != root) { json_object_put(root); }
-    json_tokener_free(tokener);
 }
 
-void audioscrobbler_api_response_get_token_json(const char *buffer, const size_t length, struct api_credentials *credentials)
+void audioscrobbler_api_response_get_token_json(json_object *root, struct api_credentials *credentials)
 {
     // {"token":"NQH5C24A6RbIOx1xWUcty1N6yOHcKcRk"}
-    if (NULL == buffer) { return; }
-    if (length == 0) { return; }
-
-    struct json_tokener *tokener = json_tokener_new();
-    json_object *root = json_tokener_parse_ex(tokener, buffer, length);
     if (NULL == root) {
         _warn("json::invalid_json_message");
-        goto _exit;
+        return;
     }
     if (json_object_object_length(root) < 1) {
         _warn("json::no_root_object");
-        goto _exit;
+        return;
     }
     json_object *tok_object = NULL;
     if (!json_object_object_get_ex(root, API_TOKEN_NODE_NAME, &tok_object) || NULL == tok_object) {
         _warn("json:missing_token_key");
-        goto _exit;
+        return;
     }
     if (!json_object_is_type(tok_object, json_type_string)) {
         _warn("json::token_is_not_string");
-        goto _exit;
+        return;
     }
     const char *value = json_object_get_string(tok_object);
     memcpy((char*)credentials->token, value, strlen(value));
     _info("json::loaded_token: %s", value);
-
-_exit:
-    if (NULL != root) { json_object_put(root); }
-    json_tokener_free(tokener);
 }
 
-bool audioscrobbler_json_document_is_error(const char *buffer, const size_t length)
+bool audioscrobbler_json_document_is_error(const json_object *root)
 {
     // {"error":14,"message":"This token has not yet been authorised"}
-    bool result = false;
-
-    if (NULL == buffer) { return result; }
-    if (length == 0) { return result; }
+    if (NULL == root || json_object_object_length(root) < 1) { return false; }
 
     json_object *err_object = NULL;
     json_object *msg_object = NULL;
 
-    struct json_tokener *tokener = json_tokener_new();
-    if (NULL == tokener) { return result; }
-    json_object *root = json_tokener_parse_ex(tokener, buffer, length);
-
-    if (NULL == root || json_object_object_length(root) < 1) {
-        goto _exit;
-    }
     json_object_object_get_ex(root, API_ERROR_NODE_NAME, &err_object);
     json_object_object_get_ex(root, API_ERROR_MESSAGE_NAME, &msg_object);
     if (NULL == err_object || !json_object_is_type(err_object, json_type_int)) {
-        goto _exit;
+        return false;
     }
     if (NULL == msg_object || !json_object_is_type(msg_object, json_type_string)) {
-        goto _exit;
+        return false;
     }
-    result = true;
-
-_exit:
-    if (NULL != root) { json_object_put(root); }
-    json_tokener_free(tokener);
-    return result;
+    return true;
 }
 
 static bool audioscrobbler_valid_credentials(const struct api_credentials *auth)
@@ -240,22 +210,96 @@ static void api_get_signature(const char *string, const char *secret, char *resu
     if (NULL == string) { return; }
     if (NULL == secret) { return; }
     if (NULL == result) { return; }
-    size_t string_len = strlen(string);
-    size_t secret_len = strlen(secret);
-    size_t len = string_len + secret_len;
-    char sig[MAX_PROPERTY_LENGTH] = {0};
 
-    // TODO(marius): this needs to change to memcpy or strncpy
-    strncat(sig, string, MAX_PROPERTY_LENGTH/2);
-    strncat(sig, secret, MAX_PROPERTY_LENGTH/2);
+    char *sig = get_zero_string(0);
+    sig = grrrs_append_cstring(sig, string);
+    sig = grrrs_append_cstring(sig, secret);
+    if (NULL == sig) { return; }
 
     unsigned char sig_hash[MD5_DIGEST_LENGTH] = {0};
 
-    md5((uint8_t*)sig, len, sig_hash);
+    md5((uint8_t*)sig, grrrs_len(sig), sig_hash);
 
     for (size_t n = 0; n < MD5_DIGEST_LENGTH; n++) {
         snprintf(result + 2 * n, 3, "%02x", sig_hash[n]);
     }
+    string_free(sig);
+}
+
+struct audioscrobbler_param {
+    char name[API_PARAM_NAME_LENGTH];
+    char *value;
+};
+
+static void audioscrobbler_add_param(struct audioscrobbler_param **params, const char *name, const char *value)
+{
+    if (NULL == value) { return; }
+
+    struct audioscrobbler_param param = {0};
+    snprintf(param.name, API_PARAM_NAME_LENGTH, "%s", name);
+    param.value = grrrs_from_string(value);
+    arrput(*params, param);
+}
+
+static void audioscrobbler_add_indexed_param(struct audioscrobbler_param **params, const char *name, int index, const char *value)
+{
+    char indexed_name[API_PARAM_NAME_LENGTH] = {0};
+    snprintf(indexed_name, API_PARAM_NAME_LENGTH, "%s[%d]", name, index);
+    audioscrobbler_add_param(params, indexed_name, value);
+}
+
+static void audioscrobbler_params_free(struct audioscrobbler_param *params)
+{
+    for (int i = 0; i < arrlen(params); i++) {
+        string_free(params[i].value);
+    }
+    arrfree(params);
+}
+
+static int audioscrobbler_param_cmp(const void *a, const void *b)
+{
+    const struct audioscrobbler_param *pa = a;
+    const struct audioscrobbler_param *pb = b;
+    return strcmp(pa->name, pb->name);
+}
+
+/*
+ * Encodes the parameters as name=value pairs separated by &, followed by their api_sig.
+ * The signature is computed over the parameters sorted by name, so for batches "album[10]"
+ * comes before "album[2]", as the service orders them.
+ */
+static char *audioscrobbler_encode_params(struct audioscrobbler_param *params, const char *secret, CURL *handle)
+{
+    int count = arrlen(params);
+    qsort(params, count, sizeof(struct audioscrobbler_param), audioscrobbler_param_cmp);
+
+    char *result = get_zero_string(0);
+    char *sig_base = get_zero_string(0);
+    for (int i = 0; i < count; i++) {
+        const struct audioscrobbler_param *param = &params[i];
+        if (NULL == param->value) { continue; }
+
+        char *esc_value = curl_easy_escape(handle, param->value, grrrs_len(param->value));
+        if (NULL == esc_value) { goto _failure; }
+        result = grrrs_append_format(result, "%s=%s&", param->name, esc_value);
+        curl_free(esc_value);
+
+        sig_base = grrrs_append_cstring(sig_base, param->name);
+        sig_base = grrrs_append(sig_base, param->value, grrrs_len(param->value));
+    }
+    if (NULL == sig_base) { goto _failure; }
+
+    char sig[MD5_HEX_LENGTH] = {0};
+    api_get_signature(sig_base, secret, sig);
+    result = grrrs_append_format(result, "api_sig=%s", sig);
+
+    string_free(sig_base);
+    return result;
+
+_failure:
+    if (NULL != sig_base) { string_free(sig_base); }
+    if (NULL != result) { string_free(result); }
+    return NULL;
 }
 
 char *api_get_url(struct api_endpoint*);
@@ -269,46 +313,24 @@ struct http_request *audioscrobbler_api_build_request_get_token(const struct api
 {
     if (!audioscrobbler_valid_credentials(auth)) { return NULL; }
 
-    const char *api_key = auth->api_key;
-    const char *secret = auth->secret;
-
-    struct http_request *request = http_request_new();
-
-    char sig_base[MAX_BODY_SIZE] = {0};
-    char *query = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == query) { return NULL; }
-
-    char *escaped_api_key = curl_easy_escape(handle, api_key, strlen(api_key));
-    size_t escaped_key_len = strlen(escaped_api_key);
-    strncat(query, "api_key=", 9);
-    strncat(query, escaped_api_key, escaped_key_len + 1);
-    strncat(query, "&", 2);
-
-    strncat(sig_base, "api_key", 8);
-    strncat(sig_base, escaped_api_key, escaped_key_len + 1);
-    curl_free(escaped_api_key);
-
-    const char *method = API_METHOD_GET_TOKEN;
-    size_t method_len = strlen(method);
-    strncat(query, "method=", 8);
-    strncat(query, method, method_len + 1);
-    strncat(query, "&", 2);
+    struct http_request *request = NULL;
+    struct audioscrobbler_param *params = NULL;
 
-    strncat(sig_base, "method", 7);
-    strncat(sig_base, method, method_len + 1);
+    audioscrobbler_add_param(&params, "api_key", auth->api_key);
+    audioscrobbler_add_param(&params, "method", API_METHOD_GET_TOKEN);
 
-    char sig[MD5_HEX_LENGTH] = {0};
-    api_get_signature(sig_base, secret, sig);
-    strncat(query, "api_sig=", 9);
-    strncat(query, sig, MD5_HEX_LENGTH);
-    strncat(query, "&", 2);
-
-    strncat(query, "format=json", 12);
+    char *query = audioscrobbler_encode_params(params, auth->secret, handle);
+    query = grrrs_append_cstring(query, "&format=json");
+    if (NULL == query) { goto _exit; }
 
+    request = http_request_new();
     request->request_type = http_post;
     request->query = query;
     request->end_point = api_endpoint_new(auth);
     request->url = api_get_url(request->end_point);
+
+_exit:
+    audioscrobbler_params_free(params);
     return request;
 }
 
@@ -339,61 +361,26 @@ struct http_request *audioscrobbler_api_build_request_get_session(const struct a
 {
     if (!audioscrobbler_valid_credentials(auth)) { return NULL; }
 
-    const char *api_key = auth->api_key;
-    const char *secret = auth->secret;
-    const char *token = auth->token;
-
-    struct http_request *request = http_request_new();
-
-    const char *method = API_METHOD_GET_SESSION;
-
-    char sig_base[MAX_BODY_SIZE] = {0};
-    char *query = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == query) { goto _failure; }
+    struct http_request *request = NULL;
+    struct audioscrobbler_param *params = NULL;
 
-    char *escaped_api_key = curl_easy_escape(handle, api_key, strlen(api_key));
-    size_t escaped_key_len = strlen(escaped_api_key);
-    strncat(query, "api_key=", 9);
-    strncat(query, escaped_api_key, escaped_key_len + 1);
-    strncat(query, "&", 2);
-
-    strncat(sig_base, "api_key", 8);
-    strncat(sig_base, escaped_api_key, escaped_key_len + 1);
-    curl_free(escaped_api_key);
-
-    size_t method_len = strlen(method);
-    strncat(query, "method=", 8);
-    strncat(query, method, method_len + 1);
-    strncat(query, "&", 2);
-
-    strncat(sig_base, "method", 7);
-    strncat(sig_base, method, method_len + 1);
-
-    size_t token_len = strlen(token);
-    strncat(query, "token=", 7);
-    strncat(query, token, token_len + 1);
-    strncat(query, "&", 2);
-
-    strncat(sig_base, "token", 6);
-    strncat(sig_base, token, token_len + 1);
-
-    char sig[MD5_HEX_LENGTH] = {0};
-    api_get_signature(sig_base, secret, sig);
-    strncat(query, "api_sig=", 9);
-    strncat(query, sig, MAX_PROPERTY_LENGTH);
-    strncat(query, "&", 2);
+    audioscrobbler_add_param(&params, "api_key", auth->api_key);
+    audioscrobbler_add_param(&params, "method", API_METHOD_GET_SESSION);
+    audioscrobbler_add_param(&params, "token", auth->token);
 
-    strncat(query, "format=json", 12);
+    char *query = audioscrobbler_encode_params(params, auth->secret, handle);
+    query = grrrs_append_cstring(query, "&format=json");
+    if (NULL == query) { goto _exit; }
 
+    request = http_request_new();
     request->request_type = http_post;
     request->query = query;
     request->end_point = api_endpoint_new(auth);
     request->url = api_get_url(request->end_point);
-    return request;
 
-_failure:
-    if (NULL != query) { grrrs_free(query); }
-    return NULL;
+_exit:
+    audioscrobbler_params_free(params);
+    return request;
 }
 
 /*
@@ -416,309 +403,116 @@ struct http_request *audioscrobbler_api_build_request_now_playing(const struct s
     assert(track_count == 1);
 
     const struct scrobble *track = tracks[0];
-    const char *api_key = auth->api_key;
-    const char *secret = auth->secret;
-    const char *sk = auth->session_key;
-
-    struct http_request *request = http_request_new();
-
-    char sig_base[MAX_BODY_SIZE] = {0};
-    char *body = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == body) { goto _failure; }
-
-    assert(track->album);
-    size_t album_len = strlen(track->album);
-    char *esc_album = curl_easy_escape(handle, track->album, album_len);
-    size_t esc_album_len = strlen(esc_album);
-    strncat(body, "album=", 7);
-    strncat(body, esc_album, esc_album_len + 1);
-    strncat(body, "&", 2);
-
-    strncat(sig_base, "album", 6);
-    strncat(sig_base, track->album, album_len + 1);
-    curl_free(esc_album);
-
-    assert(api_key);
-    size_t api_key_len = strlen(api_key);
-    char *esc_api_key = curl_easy_escape(handle, api_key, api_key_len);
-    size_t esc_api_key_len = strlen(esc_api_key);
-    strncat(body, "api_key=", 9);
-    strncat(body, esc_api_key, esc_api_key_len + 1);
-    strncat(body, "&", 2);
-
-    strncat(sig_base, "api_key", 8);
-    strncat(sig_base, api_key, api_key_len + 1);
-    curl_free(esc_api_key);
-
-    char full_artist[MAX_PROPERTY_LENGTH * MAX_PROPERTY_COUNT] = {0};
-    size_t full_artist_len = 0;
-    for (size_t i = 0; i < array_count(track->artist); i++) {
-        const char *artist = track->artist[i];
-        size_t artist_len = strlen(artist);
-        if (NULL == artist || artist_len == 0) { continue; }
-
-        if (full_artist_len > 0) {
-            size_t l_val_sep = strlen(VALUE_SEPARATOR);
-            strncat(full_artist, VALUE_SEPARATOR, l_val_sep + 1);
-            full_artist_len += l_val_sep;
-        }
-        strncat(full_artist, artist, artist_len + 1);
-        full_artist_len += artist_len;
-    }
-    if (full_artist_len > 0) {
-        char *esc_full_artist = curl_easy_escape(handle, full_artist, full_artist_len);
-        size_t esc_full_artist_len = strlen(esc_full_artist);
-        size_t artist_label_len = strlen(API_ARTIST_NODE_NAME);
-
-        strncat(body, API_ARTIST_NODE_NAME "=", artist_label_len + 2);
-        strncat(body, esc_full_artist, esc_full_artist_len + 1);
-        strncat(body, "&", 2);
-
-        strncat(sig_base, API_ARTIST_NODE_NAME, artist_label_len + 1);
-        strncat(sig_base, full_artist, full_artist_len);
-        curl_free(esc_full_artist);
-    }
 
-    char *mb_track_id = (char *) track->mb_track_id[0];
-    size_t mbid_len = strlen(mb_track_id);
-    if (mbid_len > 0) {
-        char *esc_mbid = curl_easy_escape(handle, mb_track_id, mbid_len);
-        size_t esc_mbid_len = strlen(esc_mbid);
-        size_t mbid_label_len = strlen(API_MUSICBRAINZ_MBID_NODE_NAME);
+    struct http_request *request = NULL;
+    struct audioscrobbler_param *params = NULL;
+    char *body = NULL;
+    char *query = NULL;
 
-        strncat(body, API_MUSICBRAINZ_MBID_NODE_NAME "=", mbid_label_len + 2);
-        strncat(body, esc_mbid, esc_mbid_len + 1);
-        strncat(body, "&", 2);
+    assert(scrobble_album(track));
+    audioscrobbler_add_param(&params, API_ALBUM_NODE_NAME, scrobble_album(track));
 
-        strncat(sig_base, API_MUSICBRAINZ_MBID_NODE_NAME, mbid_label_len + 1);
-        strncat(sig_base, mb_track_id, mbid_len +1);
-        curl_free(esc_mbid);
-    }
-
-    const char *method = API_METHOD_NOW_PLAYING;
-
-    assert(method);
-    size_t method_len = strlen(method);
-    strncat(body, "method=", 8);
-    strncat(body, method, method_len + 1);
-    strncat(body, "&", 2);
-
-    strncat(sig_base, "method", 7);
-    strncat(sig_base, method, method_len + 1);
+    assert(auth->api_key);
+    audioscrobbler_add_param(&params, "api_key", auth->api_key);
 
-    strncat(body, "sk=", 4);
-    strncat(body, sk, strlen(sk));
-    strncat(body, "&", 2);
+    char *full_artist = api_append_artists(get_zero_string(0), track);
+    if (NULL != full_artist && grrrs_len(full_artist) > 0) {
+        audioscrobbler_add_param(&params, API_ARTIST_NODE_NAME, full_artist);
+    }
+    if (NULL != full_artist) { string_free(full_artist); }
 
-    strncat(sig_base, "sk", 3);
-    strncat(sig_base, sk, strlen(sk));
+    const char *mb_track_id = scrobble_mb_track_id(track, 0);
+    if (strlen(mb_track_id) > 0) {
+        audioscrobbler_add_param(&params, API_MUSICBRAINZ_MBID_NODE_NAME, mb_track_id);
+    }
 
-    assert(track->title);
-    size_t title_len = strlen(track->title);
-    char *esc_title = curl_easy_escape(handle, track->title, title_len);
-    size_t esc_title_len = strlen(esc_title);
-    strncat(body, "track=", 7);
-    strncat(body, esc_title, esc_title_len + 1);
-    strncat(body, "&", 2);
+    audioscrobbler_add_param(&params, "method", API_METHOD_NOW_PLAYING);
+    audioscrobbler_add_param(&params, "sk", auth->session_key);
 
-    strncat(sig_base, "track", 6);
-    strncat(sig_base, track->title, title_len + 1);
-    curl_free(esc_title);
+    assert(scrobble_title(track));
+    audioscrobbler_add_param(&params, API_TRACK_NODE_NAME, scrobble_title(track));
 
-    char sig[MD5_HEX_LENGTH] = {0};
-    api_get_signature(sig_base, secret, sig);
-    strncat(body, "api_sig=", 9);
-    strncat(body, sig, MAX_PROPERTY_LENGTH);
+    body = audioscrobbler_encode_params(params, auth->secret, handle);
+    if (NULL == body) { goto _exit; }
 
-    char *query = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == query) { goto _failure; }
-    strncat(query, "format=json", 12);
+    query = grrrs_from_string("format=json");
+    if (NULL == query) { goto _exit; }
 
+    request = http_request_new();
     request->request_type = http_post;
     request->query = query;
     request->body = body;
-    request->body_length = strlen(body);
+    request->body_length = grrrs_len(body);
     request->end_point = api_endpoint_new(auth);
     request->url = api_get_url(request->end_point);
-    return request;
+    body = NULL;
 
-_failure:
-    if (NULL != body) { grrrs_free(body); }
-    if (NULL != query) { grrrs_free(query); }
-    return NULL;
+_exit:
+    if (NULL != body) { string_free(body); }
+    audioscrobbler_params_free(params);
+    return request;
 }
 
 struct http_request *audioscrobbler_api_build_request_scrobble(const struct scrobble *tracks[], const int track_count, const struct api_credentials *auth, CURL *handle)
 {
     if (!audioscrobbler_valid_credentials(auth)) { return NULL; }
 
-    const char *api_key = auth->api_key;
-    const char *secret = auth->secret;
-    const char *sk = auth->session_key;
-
-    struct http_request *request = http_request_new();
-
-    const char *method = API_METHOD_SCROBBLE;
-
-    char sig_base[MAX_BODY_SIZE] = {0};
-    char *body = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == body) { return NULL; }
-
-    for (int i = 0; i < track_count; i++) {
-        const struct scrobble *track = tracks[i];
-
-        size_t album_len = strlen(track->album);
-
-        char *esc_album = curl_easy_escape(handle, track->album, album_len);
-        char album_body[MAX_PROPERTY_LENGTH] = {0};
-        snprintf(album_body, MAX_PROPERTY_LENGTH, API_ALBUM_NODE_NAME "[%d]=%s&", i, esc_album);
-        strncat(body, album_body, MAX_PROPERTY_LENGTH);
-
-        char album_sig[MAX_PROPERTY_LENGTH + 19] = {0};
-        snprintf(album_sig, MAX_PROPERTY_LENGTH + 18, API_ALBUM_NODE_NAME "[%d]%s", i, track->album);
-        strncat(sig_base, album_sig, MAX_PROPERTY_LENGTH + 19);
-
-        curl_free(esc_album);
-    }
+    assert(track_count <= API_MAX_SCROBBLES_PER_REQUEST);
 
-    assert(api_key);
-    size_t api_key_len = strlen(api_key);
-    char *esc_api_key = curl_easy_escape(handle, api_key, api_key_len);
-    size_t esc_api_key_len = strlen(esc_api_key);
-    strncat(body, "api_key=", 9);
-    strncat(body, esc_api_key, esc_api_key_len + 1);
-    strncat(body, "&", 2);
+    struct http_request *request = NULL;
+    struct audioscrobbler_param *params = NULL;
+    char *body = NULL;
+    char *query = NULL;
+    char *full_artist = get_zero_string(0);
 
-    strncat(sig_base, "api_key", 8);
-    strncat(sig_base, api_key, api_key_len + 1);
-    curl_free(esc_api_key);
+    assert(auth->api_key);
+    audioscrobbler_add_param(&params, "api_key", auth->api_key);
+    audioscrobbler_add_param(&params, "method", API_METHOD_SCROBBLE);
+    assert(auth->session_key);
+    audioscrobbler_add_param(&params, "sk", auth->session_key);
 
     for (int i = 0; i < track_count; i++) {
         const struct scrobble *track = tracks[i];
 
-        char full_artist[MAX_PROPERTY_LENGTH * MAX_PROPERTY_COUNT] = {0};
-        size_t full_artist_len = 0;
-        for (unsigned j = 0; j < array_count(track->artist); j++) {
-            const char *artist = track->artist[j];
-            size_t artist_len = strlen(artist);
-            if (NULL == artist || artist_len == 0) { continue; }
-
-            if (full_artist_len > 0) {
-                size_t l_val_sep = strlen(VALUE_SEPARATOR);
-                strncat(full_artist, VALUE_SEPARATOR, l_val_sep + 1);
-                full_artist_len += l_val_sep;
-            }
-            strncat(full_artist, artist, artist_len + 1);
-            full_artist_len += artist_len;
-        }
-        if (full_artist_len > 0) {
-            char *esc_full_artist = curl_easy_escape(handle, full_artist, full_artist_len);
-
-            const char *fmt_full_artist = API_ARTIST_NODE_NAME "[%d]=%s&";
-            size_t fmt_full_artist_len = strlen(fmt_full_artist) - 4;
-
-            size_t artist_body_len = MAX_PROPERTY_LENGTH * MAX_PROPERTY_COUNT + fmt_full_artist_len;
-
-            char artist_body[artist_body_len + 1];
-            snprintf(artist_body, artist_body_len, fmt_full_artist, i, esc_full_artist);
+        audioscrobbler_add_indexed_param(&params, API_ALBUM_NODE_NAME, i, scrobble_album(track));
 
-            strncat(body, artist_body, artist_body_len);
-
-            const char *fmt_artist_sig = API_ARTIST_NODE_NAME "[%d]%s";
-            size_t fmt_artist_sig_len = strlen(fmt_full_artist) + 4;
-            size_t artist_sig_len = MAX_PROPERTY_LENGTH * MAX_PROPERTY_COUNT + fmt_artist_sig_len;
-
-            char artist_sig[artist_sig_len];
-            snprintf(artist_sig, artist_sig_len, fmt_artist_sig, i, full_artist);
-
-            strncat(sig_base, artist_sig, artist_sig_len);
-            curl_free(esc_full_artist);
+        grrrs_clear(full_artist);
+        full_artist = api_append_artists(full_artist, track);
+        if (NULL != full_artist && grrrs_len(full_artist) > 0) {
+            audioscrobbler_add_indexed_param(&params, API_ARTIST_NODE_NAME, i, full_artist);
         }
-    }
 
-    for (int i = 0; i < track_count; i++) {
-        const struct scrobble *track = tracks[i];
-
-        char *mb_track_id = (char *) track->mb_track_id[0];
-        size_t mbid_len = strlen(mb_track_id);
-        if (mbid_len > 0) {
-            char *esc_mbid = curl_easy_escape(handle, mb_track_id, mbid_len);
-
-            char mbid_body[MAX_PROPERTY_LENGTH] = {0};
-            snprintf(mbid_body, MAX_PROPERTY_LENGTH, API_MUSICBRAINZ_MBID_NODE_NAME "[%d]=%s&", i, esc_mbid);
-            strncat(body, mbid_body, MAX_PROPERTY_LENGTH);
-
-            char mbid_sig[MAX_PROPERTY_LENGTH + 18] = {0};
-            snprintf(mbid_sig, MAX_PROPERTY_LENGTH + 17, API_MUSICBRAINZ_MBID_NODE_NAME "[%d]%s", i, mb_track_id);
-            strncat(sig_base, mbid_sig, MAX_PROPERTY_LENGTH + 18);
-
-            curl_free(esc_mbid);
+        const char *mb_track_id = scrobble_mb_track_id(track, 0);
+        if (strlen(mb_track_id) > 0) {
+            audioscrobbler_add_indexed_param(&params, API_MUSICBRAINZ_MBID_NODE_NAME, i, mb_track_id);
         }
-    }
-
-    assert(method);
-    size_t method_len = strlen(method);
-    strncat(body, "method=", 8);
-    strncat(body, method, method_len + 1);
-    strncat(body, "&", 2);
 
-    strncat(sig_base, "method", 7);
-    strncat(sig_base, method, method_len + 1);
+        char tstamp[MAX_HEADER_NAME_LENGTH] = {0};
+        snprintf(tstamp, MAX_HEADER_NAME_LENGTH, "%ld", track->start_time);
+        audioscrobbler_add_indexed_param(&params, API_TIMESTAMP_NODE_NAME, i, tstamp);
 
-    assert(sk);
-    strncat(body, "sk=", 4);
-    strncat(body, sk, strlen(sk));
-    strncat(body, "&", 2);
-
-    strncat(sig_base, "sk", 3);
-    strncat(sig_base, sk, strlen(sk));
-
-    for (int i = track_count - 1; i >= 0; i--) {
-        const struct scrobble *track = tracks[i];
-
-        char tstamp_body[MAX_PROPERTY_LENGTH] = {0};
-        snprintf(tstamp_body, MAX_PROPERTY_LENGTH, API_TIMESTAMP_NODE_NAME "[%d]=%ld&", i, track->start_time);
-        strncat(body, tstamp_body, MAX_PROPERTY_LENGTH);
-
-        char tstamp_sig[MAX_PROPERTY_LENGTH] = {0};
-        snprintf(tstamp_sig, MAX_PROPERTY_LENGTH, API_TIMESTAMP_NODE_NAME "[%d]%ld", i, track->start_time);
-        strncat(sig_base, tstamp_sig, MAX_PROPERTY_LENGTH);
-    }
-
-    for (int i = track_count - 1; i >= 0; i--) {
-        const struct scrobble *track = tracks[i];
-
-        size_t title_len = strlen(track->title);
-
-        char *esc_title = curl_easy_escape(handle, track->title, title_len);
-
-        char title_body[MAX_PROPERTY_LENGTH] = {0};
-        snprintf(title_body, MAX_PROPERTY_LENGTH, API_TRACK_NODE_NAME "[%d]=%s&", i, esc_title);
-        strncat(body, title_body, MAX_PROPERTY_LENGTH);
-
-        char title_sig[MAX_PROPERTY_LENGTH + 19] = {0};
-        snprintf(title_sig, MAX_PROPERTY_LENGTH + 18, API_TRACK_NODE_NAME "[%d]%s", i, track->title);
-        strncat(sig_base, title_sig, MAX_PROPERTY_LENGTH + 19);
-
-        curl_free(esc_title);
+        audioscrobbler_add_indexed_param(&params, API_TRACK_NODE_NAME, i, scrobble_title(track));
     }
 
-    char sig[MD5_HEX_LENGTH] = {0};
-    api_get_signature(sig_base, secret, sig);
-    strncat(body, "api_sig=", 9);
-    strncat(body, sig, MAX_PROPERTY_LENGTH);
+    body = audioscrobbler_encode_params(params, auth->secret, handle);
+    if (NULL == body) { goto _exit; }
 
-    char *query = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == query) { return NULL; }
-    strncat(query, "format=json", 12);
+    query = grrrs_from_string("format=json");
+    if (NULL == query) { goto _exit; }
 
+    request = http_request_new();
     request->request_type = http_post;
     request->query = query;
     request->body = body;
-    request->body_length = strlen(body);
+    request->body_length = grrrs_len(body);
     request->end_point = api_endpoint_new(auth);
     request->url = api_get_url(request->end_point);
+    body = NULL;
 
+_exit:
+    if (NULL != body) { string_free(body); }
+    if (NULL != full_artist) { string_free(full_artist); }
+    audioscrobbler_params_free(params);
     return request;
 }
 
@@ -25,6 +25,7 @@
 #define TOKENIZED_CONFIG_PATH       "%s/%s/%s"
 #define TOKENIZED_PID_PATH          "%s/%s%s"
 #define TOKENIZED_CREDENTIALS_PATH  "%s/%s/%s"
+#define TOKENIZED_CACHE_PATH        "%s/%s/%s"
 
 #define HOME_VAR_NAME               "HOME"
 #define USERNAME_VAR_NAME           "USER"
@@ -47,6 +48,10 @@
 #define SERVICE_LABEL_LIBREFM       "librefm"
 #define SERVICE_LABEL_LISTENBRAINZ  "listenbrainz"
 #define CONFIG_KEY_IGNORE           "ignore"
+#define CONFIG_KEY_HTTP2            "http2"
+#define CONFIG_KEY_RATE_LIMIT       "rate_limit"
+#define CONFIG_KEY_RATE_BURST       "rate_burst"
+#define CONFIG_KEY_DEBOUNCE         "debounce"
 
 static const char *get_api_type_group(enum api_type end_point)
 {
@@ -256,6 +261,36 @@ char *get_credentials_file(struct configuration *config)
     return get_credentials_path(config, CREDENTIALS_FILE_NAME);
 }
 
+char *get_journal_file(struct configuration *config)
+{
+    return get_credentials_path(config, JOURNAL_FILE_NAME);
+}
+
+static char *get_cache_path(struct configuration *config, const char *file_name)
+{
+    if (NULL == config) { return NULL; }
+
+    if (NULL == file_name) {
+        file_name = "";
+    }
+
+    size_t name_len = strlen(config->name);
+    size_t cache_home_len = strlen(config->env.xdg_cache_home);
+    size_t file_len = strlen(file_name);
+    size_t path_len = name_len + cache_home_len + file_len + 2;
+
+    char *path = get_zero_string(path_len);
+    if (NULL == path) { return NULL; }
+
+    snprintf(path, path_len + 1, TOKENIZED_CACHE_PATH, config->env.xdg_cache_home, config->name, file_name);
+    return path;
+}
+
+char *get_queue_file(struct configuration *config)
+{
+    return get_cache_path(config, QUEUE_FILE_NAME);
+}
+
 static char *get_config_path(struct configuration *config, const char *file_name)
 {
     if (NULL == config) { return NULL; }
@@ -418,8 +453,31 @@ void load_config_from_file(struct configuration *config, const char* path)
         int value_count = arrlen(group->values);
         for (int j = 0; j < value_count; j++) {
             struct ini_value *val = group->values[j];
+            if (strncmp(val->key->data, CONFIG_KEY_HTTP2, val->key->len) == 0) {
+                config->http2 = (strncmp(val->value->data, CONFIG_VALUE_FALSE, strlen(CONFIG_VALUE_FALSE)) && strncmp(val->value->data, CONFIG_VALUE_ZERO, strlen(CONFIG_VALUE_ZERO)));
+                _trace("config::loaded_http2: %s", _to_bool(config->http2));
+                continue;
+            }
+            if (strncmp(val->key->data, CONFIG_KEY_RATE_LIMIT, val->key->len) == 0) {
+                config->rate_limit = strtod(val->value->data, NULL);
+                _trace("config::loaded_rate_limit: %.2lf", config->rate_limit);
+                continue;
+            }
+            if (strncmp(val->key->data, CONFIG_KEY_RATE_BURST, val->key->len) == 0) {
+                config->rate_burst = (int)strtol(val->value->data, NULL, 10);
+                if (config->rate_burst < 1) { config->rate_burst = 1; }
+                _trace("config::loaded_rate_burst: %d", config->rate_burst);
+                continue;
+            }
+            if (strncmp(val->key->data, CONFIG_KEY_DEBOUNCE, val->key->len) == 0) {
+                config->debounce = (int)strtol(val->value->data, NULL, 10);
+                if (config->debounce < 0) { config->debounce = 0; }
+                _trace("config::loaded_debounce: %dms", config->debounce);
+                continue;
+            }
             if (strncmp(val->key->data, CONFIG_KEY_IGNORE, val->key->len) != 0) {
-                break;
+                _warn("config::unknown_key: %s", val->key->data);
+                continue;
             }
             int cnt = config->ignore_players_count;
             memcpy((char*)config->ignore_players[cnt],val->value->data, val->value->len);
@@ -586,6 +644,11 @@ bool load_configuration(struct configuration *config, const char *name)
     }
 
     load_credentials(config);
+    // HTTP/2 is negotiated with the services, falling back to HTTP/1.1, unless disabled
+    config->http2 = true;
+    config->rate_limit = RATE_LIMIT_DEFAULT;
+    config->rate_burst = RATE_BURST_DEFAULT;
+    config->debounce = DEBOUNCE_DEFAULT;
     load_config(config);
 
     if (NULL != config->credentials) {
@@ -7,49 +7,23 @@
 
 #include <curl/curl.h>
 
-#define MAX_RETRIES 5
+// connections are kept around between requests, the now playing updates come at most 65s apart
+#define CONNECTION_MAX_IDLE_SECONDS     120L
+#define CONNECTION_KEEPALIVE_SECONDS    60L
+// the easy handles of the finished requests are kept for reuse, up to this many for each service
+#define MAX_IDLE_HANDLES                16
 
-static void retry_cb(int fd, short kind, void *data)
-{
-    assert(data);
-
-    struct scrobbler_connection *conn = data;
-    curl_multi_add_handle(conn->parent->handle, conn->handle);
-}
-
-void connection_retry(struct scrobbler_connection *conn)
-{
-    struct timeval retry_timeout = { .tv_sec = 3 + conn->retries, .tv_usec = 0, };
-    if (NULL != conn->response) {
-        http_response_clean(conn->response);
-    }
-
-    struct scrobbler *s = conn->parent;
-    curl_multi_remove_handle(conn->parent->handle, conn->handle);
-
-    if (conn->retries == 0) {
-        evtimer_assign(&conn->retry_event, s->evbase, retry_cb, conn);
-    } else {
-        evtimer_del(&conn->retry_event);
-    }
-    evtimer_add(&conn->retry_event, &retry_timeout);
-    conn->retries++;
-    _debug("curl::retrying[%zd]: in %2.2lfs", conn->retries, timeval_to_seconds(retry_timeout));
-}
-
-bool connection_allows_retry(const struct scrobbler_connection *conn)
+/*
+ * A request the service refused for good, retrying it later wouldn't change the outcome.
+ * Authentication failures and rate limiting are not final, as they can be resolved.
+ */
+bool connection_rejected(const struct scrobbler_connection *conn)
 {
-
     int code = conn->response->code;
-    if (code >= 400 && code < 500) {
-        // NOTE(marius): 4XX errors mean that there's something wrong with our request
-        // so we shouldn't retry.
-        return false;
-    }
-    if (conn->retries >= MAX_RETRIES) {
+    if (code < 400 || code >= 500) {
         return false;
     }
-    return true;
+    return code != 401 && code != 403 && code != 429;
 }
 
 static void scrobbler_connection_del(struct scrobbler*, int);
@@ -86,15 +60,15 @@ static void check_multi_info(struct scrobbler *s)
 
         bool success = conn->response->code == 200;
         _info(" api::submitted_to[%s]: %s", get_api_type_label(conn->credentials.end_point), (success ? "ok" : "nok"));
-        if(evtimer_pending(&s->timer_event, NULL)) {
+        // other transfers can still rely on the timer curl asked for
+        if(s->still_running <= 0 && evtimer_pending(&s->timer_event, NULL)) {
             _trace2("curl::multi_timer_remove(%p)", &s->timer_event);
             evtimer_del(&s->timer_event);
         }
-        if (success || !connection_allows_retry(conn)) {
-            scrobbler_connection_del(s, conn->idx);
-        } else {
-            connection_retry(conn);
+        if (success || connection_rejected(conn)) {
+            journal_mark_done(&s->journal, conn->journal_ids, arrlen(conn->journal_ids), 1U << conn->credentials.end_point);
         }
+        retry_connection_done(s, conn);
     }
 }
 
@@ -127,7 +101,6 @@ static void event_cb(int fd, short kind, void *data)
         ((kind & EV_WRITE) ? CURL_CSELECT_OUT : 0);
     _trace2("curl::event_cb(%p:%p:%zd:%zd): still running: %d", s, s->handle, fd, action, s->still_running);
 
-    //assert(s->connections);
     CURLMcode rc = curl_multi_socket_action(s->handle, fd, action, &s->still_running);
     if (rc != CURLM_OK) {
         _warn("curl::transfer::error: %s", curl_multi_strerror(rc));
@@ -144,81 +117,68 @@ static void event_cb(int fd, short kind, void *data)
 
 /*
  * Based on https://curl.se/libcurl/c/hiperfifo.html
- * Assign information to a scrobbler_connection structure
+ * Assign information to a scrobbler_socket structure
  */
-static void setsock(struct scrobbler_connection *conn, curl_socket_t sock, CURL *e, int act, struct scrobbler *s)
+static void setsock(struct scrobbler_socket *sock_info, curl_socket_t sock, int act, struct scrobbler *s)
 {
     int kind = ((act & CURL_POLL_IN) ? EV_READ : 0) |
         ((act & CURL_POLL_OUT) ? EV_WRITE : 0) | EV_PERSIST;
 
-    if (conn->handle != e) {
-        _trace("curl::mismatched_handle %p %p kind %zd", conn->handle, e, kind);
-        return;
-    }
-
-    conn->sockfd = sock;
-    conn->action = act;
+    sock_info->fd = sock;
+    sock_info->action = act;
 
-    if (event_initialized(&conn->ev)) {
-        event_del(&conn->ev);
+    if (event_initialized(&sock_info->ev)) {
+        event_del(&sock_info->ev);
     }
 
-    curl_multi_assign(s->handle, conn->sockfd, conn);
-    evutil_make_socket_nonblocking(conn->sockfd);
-    event_assign(&conn->ev, s->evbase, conn->sockfd, kind, event_cb, s);
-    event_add(&conn->ev, NULL);
+    evutil_make_socket_nonblocking(sock_info->fd);
+    event_assign(&sock_info->ev, s->evbase, sock_info->fd, kind, event_cb, s);
+    event_add(&sock_info->ev, NULL);
 }
 
 const char *whatstr[]={ "none", "IN", "OUT", "INOUT", "REMOVE" };
 static void dispatch(int, short, void*);
-static struct scrobbler_connection *scrobbler_connection_get(struct scrobbler *, CURL *);
-/* CURLMOPT_SOCKETFUNCTION */
-static int curl_request_has_data(CURL *e, curl_socket_t sock, int what, void *data, void *conn_data)
+/*
+ * CURLMOPT_SOCKETFUNCTION
+ * The events are kept per socket, not per connection, as multiplexed transfers share the socket
+ * and it can outlive the connection that opened it.
+ */
+static int curl_request_has_data(CURL *e, curl_socket_t sock, int what, void *data, void *socket_data)
 {
     if (NULL == data) { return 0; }
 
     struct scrobbler *s = data;
-    struct scrobbler_connection *conn = conn_data;
-    _trace2("curl::data_callback[%p:%zd]: s: %p, conn: %p", e, sock, data, conn_data);
-
-    int events = 0;
-
-    if (NULL == conn) {
-        conn = scrobbler_connection_get(s, e);
-        if (NULL == conn) {
-            // TODO(marius): I'm not sure what effect this has, but for now it prevents a segfault
-            return 0;
-        }
-        _trace2("curl::data_callback_found_connection[%zd:%p]: conn: %p", conn->idx, e, conn);
-    }
+    struct scrobbler_socket *sock_info = socket_data;
+    _trace2("curl::data_callback[%p:%zd]: s: %p, socket: %p", e, sock, data, socket_data);
 
     switch(what) {
     case CURL_POLL_IN:
     case CURL_POLL_OUT:
     case CURL_POLL_INOUT:
-        // set libevent context for a new connection
-        if(what != CURL_POLL_IN) events |= EV_WRITE;
-        if(what != CURL_POLL_OUT) events |= EV_READ;
-
-        events |= EV_PERSIST;
-
-        setsock(conn, sock, e, what, s);
-        if (conn->action != what) {
-            _trace2("curl::data_callback[%zd:%p]: s=%d, action=%s->%s", conn->idx, e, sock, whatstr[conn->action], whatstr[what]);
-        } else {
-            _trace2("curl::data_callback[%zd:%p]: s=%d, action=%s", conn->idx, e, sock, whatstr[what]);
+        if (NULL == sock_info) {
+            sock_info = calloc(1, sizeof(struct scrobbler_socket));
+            if (NULL == sock_info) {
+                _error("curl::socket_alloc_failed[%zd]", sock);
+                return -1;
+            }
+            curl_multi_assign(s->handle, sock, sock_info);
+            _trace2("curl::data_callback[%p]: s=%d, action=%s", e, sock, whatstr[what]);
+        } else if (sock_info->action != what) {
+            _trace2("curl::data_callback[%p]: s=%d, action=%s->%s", e, sock, whatstr[sock_info->action], whatstr[what]);
         }
-        return CURLM_OK;
-      break;
+        setsock(sock_info, sock, what, s);
+        break;
     case CURL_POLL_REMOVE:
-        if (sock) {
-            _trace2("curl::data_remove[%zd:%p]: action=%s", conn->idx, e, whatstr[what]);
-            curl_multi_assign(s->handle, sock, NULL);
-            //scrobbler_connection_del(s, conn->idx);
+        _trace2("curl::data_remove[%p]: s=%d, action=%s", e, sock, whatstr[what]);
+        if (NULL != sock_info) {
+            if (event_initialized(&sock_info->ev)) {
+                event_del(&sock_info->ev);
+            }
+            free(sock_info);
         }
         break;
     default:
-        _trace2("curl::unknown_socket_action[%zd:%p]: action=%s", conn->idx, e, whatstr[what]);
+        _trace2("curl::unknown_socket_action[%p]: action=%s", e, whatstr[what]);
         assert(false);
     }
 
@@ -264,12 +224,20 @@ size_t http_response_write_body(void *buffer, size_t size, size_t nmemb, void* d
     struct http_response *res = (struct http_response*)data;
 
     size_t new_size = size * nmemb;
+    if (new_size > UINT32_MAX - res->body_length) {
+        _error("curl::response_too_large: %zu bytes", res->body_length + new_size);
+        return 0;
+    }
 
-    strncat(res->body, buffer, new_size);
+    // the body grows with the chunks received, returning less than new_size makes curl fail the transfer
+    res->body = grrrs_append(res->body, buffer, (uint32_t)new_size);
+    if (NULL == res->body) {
+        _error("curl::response_alloc_failed: %zu bytes", res->body_length + new_size);
+        res->body_length = 0;
+        return 0;
+    }
     res->body_length += new_size;
-
-    assert (res->body_length < MAX_BODY_SIZE);
-    memset(res->body + res->body_length, 0x0, MAX_BODY_SIZE - res->body_length);
+    http_response_parse_json_body(res, buffer, new_size);
 
     return new_size;
 }
@@ -338,11 +306,13 @@ static int curl_debug(CURL *handle, curl_infotype type, char *data, size_t size,
 }
 #endif
 
-void build_curl_request(struct scrobbler_connection *conn)
+/*
+ * Sets the options which are the same for all the requests: the easy handles of the scrobbler
+ * get them once, as they're reused, the standalone ones (with no scrobbler) every time
+ */
+void build_curl_handle(CURL *handle, const struct scrobbler *s)
 {
-    assert (NULL != conn);
-
-    CURL *handle = conn->handle;
+    if (NULL == handle) { return; }
 
 #if LIBCURL_DEBUG
     extern enum log_levels _log_level;
@@ -352,6 +322,55 @@ void build_curl_request(struct scrobbler_connection *conn)
     }
 #endif
 
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, 7000L);
+    // reuse the connections to the services, keeping them alive while idle
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPIDLE, CONNECTION_KEEPALIVE_SECONDS);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPINTVL, CONNECTION_KEEPALIVE_SECONDS);
+#if LIBCURL_VERSION_NUM >= 0x074100
+    curl_easy_setopt(handle, CURLOPT_MAXAGE_CONN, CONNECTION_MAX_IDLE_SECONDS);
+#endif
+    if (NULL != s) {
+        if (NULL != s->share) {
+            curl_easy_setopt(handle, CURLOPT_SHARE, s->share);
+        }
+        if (s->http2) {
+            // HTTP/2 over TLS when the service supports it, HTTP/1.1 otherwise
+            // and wait for a connection that can be multiplexed rather than opening a new one
+            curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+        } else {
+            curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+        }
+    }
+
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_HEADER, 0L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, http_response_write_body);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, http_response_write_headers);
+}
+
+/*
+ * Drops the options pointing to the data of the finished request, so the handle can be reused
+ */
+void clear_curl_request(CURL *handle)
+{
+    if (NULL == handle) { return; }
+
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, NULL);
+    curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, NULL);
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDS, NULL);
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, NULL);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, NULL);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, NULL);
+}
+
+void build_curl_request(struct scrobbler_connection *conn)
+{
+    assert (NULL != conn);
+
+    CURL *handle = conn->handle;
+
     const struct http_request *req = conn->request;
     struct http_response *resp = conn->response;
     struct curl_slist ***req_headers = &conn->headers;
@@ -362,6 +381,9 @@ void build_curl_request(struct scrobbler_connection *conn)
     if (t == http_post) {
         curl_easy_setopt(handle, CURLOPT_POSTFIELDS, req->body);
         curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long)req->body_length);
+    } else {
+        // the handle might have been used for a POST before
+        curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
     }
 
     char *url = http_request_get_url(req);
@@ -369,18 +391,10 @@ void build_curl_request(struct scrobbler_connection *conn)
 
     curl_easy_setopt(handle, CURLOPT_PRIVATE, conn);
     curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, conn->error);
-    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, 7000L);
-    //curl_easy_setopt(handle, CURLOPT_MAXCONNECTS, 1L);
-    curl_easy_setopt(handle, CURLOPT_FRESH_CONNECT, 1L);
-    curl_easy_setopt(handle, CURLOPT_FORBID_REUSE, 1L);
-
-    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(handle, CURLOPT_URL, url);
-    curl_easy_setopt(handle, CURLOPT_HEADER, 0L);
+    struct curl_slist *headers = NULL;
     int headers_count = arrlen(req->headers);
     if (headers_count > 0) {
-        struct curl_slist *headers = NULL;
-
         for (int i = 0; i < headers_count; i++) {
             struct http_header *header = req->headers[i];
             char full_header[MAX_URL_LENGTH] = {0};
@@ -388,14 +402,12 @@ void build_curl_request(struct scrobbler_connection *conn)
 
             headers = curl_slist_append(headers, full_header);
         }
-        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
         arrput(*req_headers, headers);
     }
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
     string_free(url);
 
-    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, http_response_write_body);
     curl_easy_setopt(handle, CURLOPT_WRITEDATA, resp);
-    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, http_response_write_headers);
     curl_easy_setopt(handle, CURLOPT_HEADERDATA, resp);
 }
 
@@ -9,6 +9,8 @@
 #include "sstrings.h"
 #include "structs.h"
 #include "utils.h"
+#include "arena.h"
+#include "scrobble_record.h"
 #include "api.h"
 #include "smpris.h"
 #include "scrobbler.h"
@@ -0,0 +1,657 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+#ifndef MPRIS_SCROBBLER_JOURNAL_H
+#define MPRIS_SCROBBLER_JOURNAL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define JOURNAL_FILE_NAME           "journal"
+#define JOURNAL_TEMP_SUFFIX         ".tmp"
+#define JOURNAL_MAGIC               "MPSJ"
+#define JOURNAL_VERSION             3U
+#define JOURNAL_SYNC_INTERVAL       1 // seconds
+#define JOURNAL_COMPACT_THRESHOLD   256
+#define JOURNAL_SERVICES_ALL        0xffffffffU
+#define JOURNAL_FNV_OFFSET          2166136261U
+#define JOURNAL_FNV_PRIME           16777619U
+
+/*
+ * The journal is an append only file:
+ *  - a header with the magic string and the format version
+ *  - a list of records, each one with a checksummed header and a payload
+ *
+ * "add" records hold a serialized scrobble in their payload and the mask of
+ * services that already accepted it.
+ * "done" records have no payload and mark the services that accepted the
+ * scrobble with the same id. Discarded scrobbles are marked done for all services.
+ */
+enum journal_record_type {
+    journal_record_add = 1U,
+    journal_record_done = 2U,
+};
+
+struct journal_header {
+    char magic[4];
+    uint32_t version;
+};
+
+struct journal_record {
+    uint32_t checksum; // FNV-1a of everything following it, header and payload
+    uint32_t length;   // payload length
+    uint64_t id;
+    uint32_t type;
+    uint32_t services;
+};
+
+struct journal_entry {
+    uint64_t id;
+    unsigned services;
+    size_t offset; // payload offset in the journal data
+    size_t length;
+};
+
+static uint32_t journal_checksum(uint32_t hash, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= JOURNAL_FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint32_t journal_record_checksum(const struct journal_record *rec, const char *payload)
+{
+    uint32_t hash = journal_checksum(JOURNAL_FNV_OFFSET, (const char*)rec + sizeof(rec->checksum), sizeof(*rec) - sizeof(rec->checksum));
+    return journal_checksum(hash, payload, rec->length);
+}
+
+static inline bool journal_entry_pending(unsigned services, unsigned required)
+{
+    if (services == JOURNAL_SERVICES_ALL) { return false; }
+    // with no services enabled we keep everything around until they are
+    if (required == 0) { return true; }
+    return (services & required) != required;
+}
+
+static void journal_reset(char **buffer)
+{
+    if (arrlen(*buffer) > 0) {
+        arrdeln(*buffer, 0, arrlen(*buffer));
+    }
+}
+
+static void journal_put(char **buffer, const void *data, size_t length)
+{
+    size_t offset = arrlen(*buffer);
+    arraddn(*buffer, length);
+    memcpy(*buffer + offset, data, length);
+}
+
+/*
+ * Scrobbles are stored as they are in memory: the numeric fields, the offset table and the string pool
+ */
+static void journal_serialize_scrobble(char **buffer, const struct scrobble *s)
+{
+    journal_put(buffer, s, scrobble_size(s));
+}
+
+static struct scrobble *journal_deserialize_scrobble(const char *data, size_t length)
+{
+    struct scrobble *s = scrobble_load(data, length);
+    if (NULL == s) { return NULL; }
+
+    s->scrobbled = false;
+    s->journal_id = 0;
+    s->journal_services = 0;
+    return s;
+}
+
+static bool journal_write_all(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+static bool journal_read_all(int fd, char **data, size_t *length, off_t limit)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) { return false; }
+
+    size_t size = st.st_size;
+    if (limit >= 0 && (size_t)limit < size) {
+        size = limit;
+    }
+    char *result = malloc(size + 1);
+    if (NULL == result) { return false; }
+
+    size_t total = 0;
+    while (total < size) {
+        ssize_t r = pread(fd, result + total, size - total, total);
+        if (r < 0 && errno == EINTR) { continue; }
+        if (r < 0) {
+            free(result);
+            return false;
+        }
+        // the file got shorter since fstat
+        if (r == 0) { break; }
+        total += r;
+    }
+
+    *data = result;
+    *length = total;
+    return true;
+}
+
+static void journal_record_build(char **buffer, enum journal_record_type type, uint64_t id, unsigned services, const struct scrobble *track)
+{
+    struct journal_record rec = {
+        .id = id,
+        .type = type,
+        .services = services,
+    };
+
+    journal_reset(buffer);
+    journal_put(buffer, &rec, sizeof(rec));
+    if (NULL != track) {
+        journal_serialize_scrobble(buffer, track);
+    }
+
+    rec.length = arrlen(*buffer) - sizeof(rec);
+    rec.checksum = journal_record_checksum(&rec, *buffer + sizeof(rec));
+    memcpy(*buffer, &rec, sizeof(rec));
+}
+
+/*
+ * Scans journal data, collecting the "add" entries with the services which accepted them
+ * Returns the length of the valid data, anything after that is a torn, or corrupted, tail.
+ */
+static size_t journal_scan(const char *data, size_t length, struct journal_entry **entries, size_t *done_count)
+{
+    size_t pos = sizeof(struct journal_header);
+    size_t dones = 0;
+
+    while (length - pos >= sizeof(struct journal_record)) {
+        struct journal_record rec;
+        memcpy(&rec, data + pos, sizeof(rec));
+        if (rec.length > length - pos - sizeof(rec)) { break; }
+
+        const char *payload = data + pos + sizeof(rec);
+        if (rec.checksum != journal_record_checksum(&rec, payload)) { break; }
+
+        if (rec.type == journal_record_add) {
+            struct journal_entry entry = {
+                .id = rec.id,
+                .services = rec.services,
+                .offset = pos + sizeof(rec),
+                .length = rec.length,
+            };
+            arrput(*entries, entry);
+        } else if (rec.type == journal_record_done) {
+            // ids are increasing through the file, so we can look them up by bisecting
+            int lo = 0, hi = arrlen(*entries) - 1;
+            while (lo <= hi) {
+                int mid = lo + (hi - lo) / 2;
+                struct journal_entry *cur = &(*entries)[mid];
+                if (cur->id == rec.id) {
+                    cur->services |= rec.services;
+                    break;
+                }
+                if (cur->id < rec.id) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid - 1;
+                }
+            }
+            dones++;
+        } else {
+            break;
+        }
+        pos += sizeof(rec) + rec.length;
+    }
+    if (NULL != done_count) {
+        *done_count = dones;
+    }
+    return pos;
+}
+
+static bool journal_header_valid(const char *data, size_t length)
+{
+    if (length < sizeof(struct journal_header)) { return false; }
+
+    struct journal_header header;
+    memcpy(&header, data, sizeof(header));
+    return memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) == 0 && header.version == JOURNAL_VERSION;
+}
+
+static bool journal_write_header(int fd)
+{
+    struct journal_header header = { .version = JOURNAL_VERSION, };
+    memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    return journal_write_all(fd, (const char*)&header, sizeof(header));
+}
+
+static char *journal_temp_path(const char *path)
+{
+    size_t path_len = strlen(path) + strlen(JOURNAL_TEMP_SUFFIX);
+    char *temp = get_zero_string(path_len);
+    if (NULL == temp) { return NULL; }
+
+    snprintf(temp, path_len + 1, "%s%s", path, JOURNAL_TEMP_SUFFIX);
+    return temp;
+}
+
+/*
+ * Creates the folder holding the file at path, if it's missing
+ */
+static bool journal_create_folder(const char *path)
+{
+    bool status = true;
+    char *dir = grrrs_from_string(path);
+    char *sep = strrchr(dir, '/');
+    if (NULL != sep) {
+        *sep = '\0';
+        if (mkdir(dir, S_IRWXU) != 0 && errno != EEXIST) {
+            _warn("journal::unable to create folder %s: %s", dir, strerror(errno));
+            status = false;
+        }
+    }
+    grrrs_free(dir);
+    return status;
+}
+
+static void journal_sync_dir(const char *path)
+{
+    char *dir = grrrs_from_string(path);
+    char *sep = strrchr(dir, '/');
+    if (NULL != sep) {
+        *sep = '\0';
+        int fd = open(dir, O_RDONLY | O_DIRECTORY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+    grrrs_free(dir);
+}
+
+/*
+ * Runs on its own thread: rewrites the journal up to the snapshot offset
+ * into a temporary file which only holds the pending entries.
+ */
+static void *journal_compact_run(void *data)
+{
+    struct scrobble_journal *j = data;
+
+    char *snapshot = NULL;
+    size_t length = 0;
+    char *buffer = NULL;
+    struct journal_entry *entries = NULL;
+    char *temp_path = journal_temp_path(j->path);
+    int out = -1;
+
+    j->compaction.succeeded = false;
+    j->compaction.kept = 0;
+
+    int in = open(j->path, O_RDONLY);
+    if (in < 0) { goto _exit; }
+    if (!journal_read_all(in, &snapshot, &length, j->compaction.snapshot_end)) { goto _exit; }
+    if (!journal_header_valid(snapshot, length)) { goto _exit; }
+
+    journal_scan(snapshot, length, &entries, NULL);
+
+    out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (out < 0) { goto _exit; }
+    if (!journal_write_header(out)) { goto _exit; }
+
+    for (int i = 0; i < arrlen(entries); i++) {
+        struct journal_entry *entry = &entries[i];
+        if (!journal_entry_pending(entry->services, j->compaction.required_services)) {
+            continue;
+        }
+        struct journal_record rec = {
+            .length = entry->length,
+            .id = entry->id,
+            .type = journal_record_add,
+            .services = entry->services,
+        };
+        rec.checksum = journal_record_checksum(&rec, snapshot + entry->offset);
+
+        journal_reset(&buffer);
+        journal_put(&buffer, &rec, sizeof(rec));
+        journal_put(&buffer, snapshot + entry->offset, entry->length);
+        if (!journal_write_all(out, buffer, arrlen(buffer))) { goto _exit; }
+        j->compaction.kept++;
+    }
+    if (fsync(out) != 0) { goto _exit; }
+    j->compaction.succeeded = true;
+
+_exit:
+    if (out >= 0) { close(out); }
+    if (in >= 0) { close(in); }
+    if (NULL != snapshot) { free(snapshot); }
+    if (NULL != entries) { arrfree(entries); }
+    if (NULL != buffer) { arrfree(buffer); }
+    if (NULL != temp_path) { string_free(temp_path); }
+
+    event_active(&j->compact_event, EV_TIMEOUT, 0);
+    return NULL;
+}
+
+/*
+ * Back on the main thread: append whatever got written to the journal since the snapshot
+ * to the compacted file and swap it in place.
+ */
+static void journal_compact_finish(struct scrobble_journal *j)
+{
+    if (!j->compaction.running) { return; }
+
+    pthread_join(j->compaction.thread, NULL);
+    j->compaction.running = false;
+
+    char *temp_path = journal_temp_path(j->path);
+    char *tail = NULL;
+    int out = -1;
+    bool swapped = false;
+
+    if (!j->compaction.succeeded) {
+        _warn("journal::compact:failed: %s", j->path);
+        goto _exit;
+    }
+
+    // it becomes the journal, which gets read back for the replays and the next compaction
+    out = open(temp_path, O_RDWR | O_APPEND);
+    if (out < 0) { goto _exit; }
+
+    off_t end = lseek(j->fd, 0, SEEK_END);
+    if (end > j->compaction.snapshot_end) {
+        size_t tail_length = end - j->compaction.snapshot_end;
+        tail = malloc(tail_length);
+        if (NULL == tail) { goto _exit; }
+        if (pread(j->fd, tail, tail_length, j->compaction.snapshot_end) != (ssize_t)tail_length) { goto _exit; }
+        if (!journal_write_all(out, tail, tail_length)) { goto _exit; }
+    }
+    if (fsync(out) != 0) { goto _exit; }
+    if (rename(temp_path, j->path) != 0) { goto _exit; }
+    journal_sync_dir(j->path);
+
+    close(j->fd);
+    j->fd = out;
+    out = -1;
+    j->dirty = false;
+    swapped = true;
+
+    j->add_count = j->compaction.kept + (j->add_count - j->compaction.add_count);
+    j->done_count -= j->compaction.done_count;
+    _debug("journal::compacted: %zu pending entries", j->add_count);
+
+_exit:
+    if (out >= 0) { close(out); }
+    if (!swapped && NULL != temp_path) { unlink(temp_path); }
+    if (NULL != tail) { free(tail); }
+    if (NULL != temp_path) { string_free(temp_path); }
+}
+
+static void journal_compact_cb(evutil_socket_t fd, short event, void *data)
+{
+    assert(data);
+    journal_compact_finish((struct scrobble_journal*)data);
+}
+
+static void journal_maybe_compact(struct scrobble_journal *j)
+{
+    if (j->fd < 0 || j->compaction.running) { return; }
+    // every "done" record points to an entry which is possibly garbage
+    if (j->done_count < JOURNAL_COMPACT_THRESHOLD || j->done_count < j->add_count / 2) { return; }
+
+    j->compaction.snapshot_end = lseek(j->fd, 0, SEEK_END);
+    j->compaction.required_services = j->required_services;
+    j->compaction.add_count = j->add_count;
+    j->compaction.done_count = j->done_count;
+    j->compaction.running = true;
+
+    if (pthread_create(&j->compaction.thread, NULL, journal_compact_run, j) != 0) {
+        _warn("journal::compact:unable to start thread");
+        j->compaction.running = false;
+        return;
+    }
+    _trace("journal::compact:started[%zu:%zu]", j->add_count, j->done_count);
+}
+
+static void journal_sync(struct scrobble_journal *j)
+{
+    if (j->fd < 0 || !j->dirty) { return; }
+
+    if (fdatasync(j->fd) != 0) {
+        _warn("journal::sync:failed: %s", strerror(errno));
+    }
+    j->dirty = false;
+}
+
+static void journal_sync_cb(evutil_socket_t fd, short event, void *data)
+{
+    assert(data);
+    struct scrobble_journal *j = data;
+
+    journal_sync(j);
+    journal_maybe_compact(j);
+}
+
+static void journal_append(struct scrobble_journal *j)
+{
+    if (!journal_write_all(j->fd, j->buffer, arrlen(j->buffer))) {
+        _warn("journal::write:failed: %s", strerror(errno));
+        return;
+    }
+    j->dirty = true;
+    // group the fsync calls for all records written in the same interval
+    if (event_initialized(&j->sync_event) && !evtimer_pending(&j->sync_event, NULL)) {
+        struct timeval interval = { .tv_sec = JOURNAL_SYNC_INTERVAL, .tv_usec = 0, };
+        evtimer_add(&j->sync_event, &interval);
+    }
+}
+
+uint64_t journal_add(struct scrobble_journal *j, const struct scrobble *track)
+{
+    if (NULL == j || j->fd < 0 || NULL == track) { return 0; }
+
+    uint64_t id = j->next_id++;
+    journal_record_build(&j->buffer, journal_record_add, id, 0, track);
+    journal_append(j);
+    j->add_count++;
+
+    _trace2("journal::add[%" PRIu64 "]: %s//%s//%s", id, scrobble_title(track), scrobble_artist(track, 0), scrobble_album(track));
+    return id;
+}
+
+void journal_mark_done(struct scrobble_journal *j, const uint64_t ids[], size_t count, unsigned services)
+{
+    if (NULL == j || j->fd < 0 || NULL == ids) { return; }
+
+    for (size_t i = 0; i < count; i++) {
+        if (ids[i] == 0) { continue; }
+        journal_record_build(&j->buffer, journal_record_done, ids[i], services, NULL);
+        journal_append(j);
+        j->done_count++;
+        _trace2("journal::done[%" PRIu64 "]: %#x", ids[i], services);
+    }
+}
+
+void journal_discard(struct scrobble_journal *j, uint64_t id)
+{
+    journal_mark_done(j, &id, 1, JOURNAL_SERVICES_ALL);
+}
+
+/*
+ * Loads the entries which the service didn't accept yet, skipping the excluded ids, which are sorted.
+ * The scrobbles are marked as accepted by all the other services, so they're only sent to this one.
+ * Returns an array with the loaded scrobbles, which belong to the caller
+ */
+struct scrobble **journal_load_pending(struct scrobble_journal *j, unsigned service, const uint64_t exclude[], size_t exclude_count)
+{
+    char *data = NULL;
+    size_t length = 0;
+    struct journal_entry *entries = NULL;
+    struct scrobble **result = NULL;
+
+    if (NULL == j || j->fd < 0) { goto _exit; }
+    if (!journal_read_all(j->fd, &data, &length, -1)) {
+        _warn("journal::load_pending:unable to read %s", j->path);
+        goto _exit;
+    }
+    if (!journal_header_valid(data, length)) { goto _exit; }
+
+    journal_scan(data, length, &entries, NULL);
+    size_t k = 0;
+    for (int i = 0; i < arrlen(entries); i++) {
+        struct journal_entry *entry = &entries[i];
+        if (entry->services == JOURNAL_SERVICES_ALL || (entry->services & service) == service) {
+            continue;
+        }
+        // the entries are in increasing id order too
+        while (k < exclude_count && exclude[k] < entry->id) { k++; }
+        if (k < exclude_count && exclude[k] == entry->id) { continue; }
+
+        struct scrobble *track = journal_deserialize_scrobble(data + entry->offset, entry->length);
+        if (NULL == track) {
+            _warn("journal::load_pending:invalid entry %" PRIu64, entry->id);
+            continue;
+        }
+        track->journal_id = entry->id;
+        track->journal_services = JOURNAL_SERVICES_ALL & ~service;
+        arrput(result, track);
+    }
+    _debug("journal::loaded_pending[%#x]: %zd scrobbles", service, arrlen(result));
+
+_exit:
+    if (NULL != data) { free(data); }
+    if (NULL != entries) { arrfree(entries); }
+    return result;
+}
+
+void scrobble_queue_push(struct scrobble_queue*, struct scrobble*);
+/*
+ * Opens the journal and loads the pending entries in the queue
+ * Returns the number of loaded scrobbles
+ */
+int journal_open(struct scrobble_journal *j, const char *path, struct event_base *evbase, struct scrobble_queue *queue)
+{
+    char *data = NULL;
+    size_t length = 0;
+    struct journal_entry *entries = NULL;
+    int loaded = 0;
+
+    j->fd = -1;
+    j->next_id = 1;
+    if (NULL == path) { goto _exit; }
+
+    j->path = grrrs_from_string(path);
+    journal_create_folder(j->path);
+
+    j->fd = open(j->path, O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+    if (j->fd < 0) {
+        _warn("journal::open:failed %s: %s", j->path, strerror(errno));
+        goto _exit;
+    }
+    if (!journal_read_all(j->fd, &data, &length, -1)) {
+        _warn("journal::open:unable to read %s", j->path);
+        close(j->fd);
+        j->fd = -1;
+        goto _exit;
+    }
+
+    if (!journal_header_valid(data, length)) {
+        if (length > 0) {
+            _warn("journal::open:invalid header, discarding %s", j->path);
+        }
+        if (ftruncate(j->fd, 0) != 0 || !journal_write_header(j->fd)) {
+            _warn("journal::open:unable to initialize %s", j->path);
+            close(j->fd);
+            j->fd = -1;
+        }
+        goto _exit;
+    }
+
+    size_t done_count = 0;
+    size_t valid_length = journal_scan(data, length, &entries, &done_count);
+    if (valid_length < length) {
+        _warn("journal::open:truncating %zu bytes of invalid data", length - valid_length);
+        if (ftruncate(j->fd, valid_length) != 0) {
+            _warn("journal::open:unable to truncate %s", j->path);
+        }
+    }
+
+    int entries_count = arrlen(entries);
+    j->add_count = entries_count;
+    j->done_count = done_count;
+    if (entries_count > 0) {
+        j->next_id = entries[entries_count - 1].id + 1;
+    }
+
+    for (int i = 0; i < entries_count; i++) {
+        struct journal_entry *entry = &entries[i];
+        if (!journal_entry_pending(entry->services, j->required_services)) {
+            continue;
+        }
+        struct scrobble *track = journal_deserialize_scrobble(data + entry->offset, entry->length);
+        if (NULL == track) {
+            _warn("journal::open:invalid entry %" PRIu64, entry->id);
+            continue;
+        }
+        track->journal_id = entry->id;
+        track->journal_services = entry->services;
+        scrobble_queue_push(queue, track);
+        loaded++;
+    }
+    _debug("journal::loaded[%zu:%zu]: %d pending scrobbles", j->add_count, j->done_count, loaded);
+
+_exit:
+    if (NULL != data) { free(data); }
+    if (NULL != entries) { arrfree(entries); }
+
+    if (j->fd >= 0 && NULL != evbase) {
+        evtimer_assign(&j->sync_event, evbase, journal_sync_cb, j);
+        event_assign(&j->compact_event, evbase, -1, 0, journal_compact_cb, j);
+    }
+    return loaded;
+}
+
+void journal_close(struct scrobble_journal *j)
+{
+    if (NULL == j) { return; }
+
+    journal_compact_finish(j);
+    if (event_initialized(&j->sync_event)) {
+        evtimer_del(&j->sync_event);
+    }
+    if (event_initialized(&j->compact_event)) {
+        event_del(&j->compact_event);
+    }
+    journal_sync(j);
+    if (j->fd >= 0) {
+        close(j->fd);
+        j->fd = -1;
+    }
+    if (NULL != j->path) {
+        grrrs_free(j->path);
+        j->path = NULL;
+    }
+    if (NULL != j->buffer) {
+        arrfree(j->buffer);
+        j->buffer = NULL;
+    }
+}
+
+#endif // MPRIS_SCROBBLER_JOURNAL_H
@@ -39,6 +39,7 @@
 #define LISTENBRAINZ_API_VERSION        "1"
 
 #define API_ENDPOINT_SUBMIT_LISTEN      "submit-listens"
+#define API_MAX_LISTENS_PER_REQUEST     1000
 
 static bool listenbrainz_valid_credentials(const struct api_credentials *auth)
 {
@@ -68,9 +69,6 @@ struct http_request *listenbrainz_api_build_request_now_playing(const struct scr
 
     const char *token = auth->token;
 
-    char *body = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == body) { return NULL; }
-
     json_object *root = json_object_new_object();
     json_object_object_add(root, API_LISTEN_TYPE_NODE_NAME, json_object_new_string(API_LISTEN_TYPE_NOW_PLAYING));
 
@@ -78,32 +76,19 @@ struct http_request *listenbrainz_api_build_request_now_playing(const struct scr
 
     json_object *payload_elem = json_object_new_object();
     json_object *metadata = json_object_new_object();
-    json_object_object_add(metadata, API_ALBUM_NAME_NODE_NAME, json_object_new_string(track->album));
-
-    char full_artist[MAX_PROPERTY_LENGTH * MAX_PROPERTY_COUNT] = {0};
-    size_t full_artist_len = 0;
-    for (size_t i = 0; i < array_count(track->artist); i++) {
-        const char *artist = track->artist[i];
-        size_t artist_len = strlen(artist);
-        if (NULL == artist || artist_len == 0) { continue; }
-
-        if (full_artist_len > 0) {
-            size_t l_val_sep = strlen(VALUE_SEPARATOR);
-            strncat(full_artist, VALUE_SEPARATOR, l_val_sep + 1);
-            full_artist_len += l_val_sep;
-        }
-        strncat(full_artist, artist, MAX_PROPERTY_LENGTH);
-        full_artist_len += artist_len;
-    }
-    if (full_artist_len > 0) {
+    json_object_object_add(metadata, API_ALBUM_NAME_NODE_NAME, json_object_new_string(scrobble_album(track)));
+
+    char *full_artist = api_append_artists(get_zero_string(0), track);
+    if (NULL != full_artist && grrrs_len(full_artist) > 0) {
         json_object_object_add(metadata, API_ARTIST_NAME_NODE_NAME, json_object_new_string(full_artist));
     }
-    json_object_object_add(metadata, API_TRACK_NAME_NODE_NAME, json_object_new_string(track->title));
+    if (NULL != full_artist) { string_free(full_artist); }
+    json_object_object_add(metadata, API_TRACK_NAME_NODE_NAME, json_object_new_string(scrobble_title(track)));
 
-    char *mb_track_id = (char*)track->mb_track_id[0];
-    char *mb_artist_id = (char*)track->mb_artist_id[0];
-    char *mb_album_id = (char*)track->mb_album_id[0];
-    if (strlen(mb_track_id) > 0 || strlen(mb_artist_id) > 0 || strlen(mb_album_id) > 0 || strlen(track->mb_spotify_id) > 0) {
+    const char *mb_track_id = scrobble_mb_track_id(track, 0);
+    const char *mb_artist_id = scrobble_mb_artist_id(track, 0);
+    const char *mb_album_id = scrobble_mb_album_id(track, 0);
+    if (strlen(mb_track_id) > 0 || strlen(mb_artist_id) > 0 || strlen(mb_album_id) > 0 || strlen(scrobble_spotify_id(track)) > 0) {
         json_object *additional_info = json_object_new_object();
 
         if (strlen(mb_track_id) > 0) {
@@ -117,8 +102,8 @@ struct http_request *listenbrainz_api_build_request_now_playing(const struct scr
         if (strlen(mb_album_id) > 0) {
             json_object_object_add(additional_info, API_MUSICBRAINZ_ALBUM_ID_NODE_NAME, json_object_new_string(mb_album_id));
         }
-        if (strlen(track->mb_spotify_id) > 0) {
-            json_object_object_add(additional_info, API_MUSICBRAINZ_SPOTIFY_ID_NODE_NAME, json_object_new_string(track->mb_spotify_id));
+        if (strlen(scrobble_spotify_id(track)) > 0) {
+            json_object_object_add(additional_info, API_MUSICBRAINZ_SPOTIFY_ID_NODE_NAME, json_object_new_string(scrobble_spotify_id(track)));
         }
 
         json_object_object_add(metadata, API_ADDITIONAL_INFO_NODE_NAME, additional_info);
@@ -128,8 +113,11 @@ struct http_request *listenbrainz_api_build_request_now_playing(const struct scr
     json_object_array_add(payload, payload_elem);
     json_object_object_add(root, API_PAYLOAD_NODE_NAME, payload);
 
-    const char *json_str = json_object_to_json_string(root);
-    strncpy(body, json_str, MAX_BODY_SIZE);
+    char *body = grrrs_from_string(json_object_to_json_string(root));
+    if (NULL == body) {
+        json_object_put(root);
+        return NULL;
+    }
 
     struct http_request *request = http_request_new();
     arrput(request->headers, http_authorization_header_new(token));
@@ -137,10 +125,10 @@ struct http_request *listenbrainz_api_build_request_now_playing(const struct scr
 
     request->request_type = http_post;
     request->body = body;
-    request->body_length = strlen(body);
+    request->body_length = grrrs_len(body);
     request->end_point = api_endpoint_new(auth);
     request->url = api_get_url(request->end_point);
-    strncpy(request->url + strlen(request->url), API_ENDPOINT_SUBMIT_LISTEN, strlen(API_ENDPOINT_SUBMIT_LISTEN) + 1);
+    request->url = grrrs_append_cstring(request->url, API_ENDPOINT_SUBMIT_LISTEN);
 
     json_object_put(root);
 
@@ -155,11 +143,6 @@ struct http_request *listenbrainz_api_build_request_scrobble(const struct scrobb
 
     const char *token = auth->token;
 
-    char *body = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == body) { return NULL; }
-    char *query = get_zero_string(MAX_BODY_SIZE);
-    if (NULL == query) { return NULL; }
-
     json_object *root = json_object_new_object();
     if (track_count > 1) {
         json_object_object_add(root, API_LISTEN_TYPE_NODE_NAME, json_object_new_string(API_LISTEN_TYPE_IMPORT));
@@ -172,34 +155,21 @@ struct http_request *listenbrainz_api_build_request_scrobble(const struct scrobb
         const struct scrobble *track = tracks[i];
         json_object *payload_elem = json_object_new_object();
         json_object *metadata = json_object_new_object();
-        if (strlen(track->album) > 0) {
-            json_object_object_add(metadata, API_ALBUM_NAME_NODE_NAME, json_object_new_string(track->album));
+        if (strlen(scrobble_album(track)) > 0) {
+            json_object_object_add(metadata, API_ALBUM_NAME_NODE_NAME, json_object_new_string(scrobble_album(track)));
         }
-        char full_artist[MAX_PROPERTY_LENGTH * MAX_PROPERTY_COUNT] = {0};
-        size_t full_artist_len = 0;
-        for (size_t i = 0; i < array_count(track->artist); i++) {
-            const char *artist = track->artist[i];
-            size_t artist_len = strlen(artist);
-            if (NULL == artist || artist_len == 0) { continue; }
-
-            if (full_artist_len > 0) {
-                size_t l_val_sep = strlen(VALUE_SEPARATOR);
-                strncat(full_artist, VALUE_SEPARATOR, l_val_sep + 1);
-                full_artist_len += l_val_sep;
-            }
-            strncat(full_artist, artist, MAX_PROPERTY_LENGTH);
-            full_artist_len += artist_len;
-        }
-        if (full_artist_len > 0) {
+        char *full_artist = api_append_artists(get_zero_string(0), track);
+        if (NULL != full_artist && grrrs_len(full_artist) > 0) {
             json_object_object_add(metadata, API_ARTIST_NAME_NODE_NAME, json_object_new_string(full_artist));
         }
-        if (strlen(track->title) > 0) {
-            json_object_object_add(metadata, API_TRACK_NAME_NODE_NAME, json_object_new_string(track->title));
+        if (NULL != full_artist) { string_free(full_artist); }
+        if (strlen(scrobble_title(track)) > 0) {
+            json_object_object_add(metadata, API_TRACK_NAME_NODE_NAME, json_object_new_string(scrobble_title(track)));
         }
-        char *mb_track_id = (char*)track->mb_track_id[0];
-        char *mb_artist_id = (char*)track->mb_artist_id[0];
-        char *mb_album_id = (char*)track->mb_album_id[0];
-        if ( (strlen(mb_track_id) > 0)|| (strlen(mb_artist_id) > 0) || (strlen(mb_album_id) > 0) || (strlen(track->mb_spotify_id) > 0)) {
+        const char *mb_track_id = scrobble_mb_track_id(track, 0);
+        const char *mb_artist_id = scrobble_mb_artist_id(track, 0);
+        const char *mb_album_id = scrobble_mb_album_id(track, 0);
+        if ( (strlen(mb_track_id) > 0)|| (strlen(mb_artist_id) > 0) || (strlen(mb_album_id) > 0) || (strlen(scrobble_spotify_id(track)) > 0)) {
             json_object *additional_info = json_object_new_object();
             if (strlen(mb_track_id) > 0) {
                 json_object_object_add(additional_info, API_MUSICBRAINZ_RECORDING_ID_NODE_NAME, json_object_new_string(mb_track_id));
@@ -212,8 +182,8 @@ struct http_request *listenbrainz_api_build_request_scrobble(const struct scrobb
             if (strlen(mb_album_id) > 0) {
                 json_object_object_add(additional_info, API_MUSICBRAINZ_ALBUM_ID_NODE_NAME, json_object_new_string(mb_album_id));
             }
-            if (strlen(track->mb_spotify_id) > 0) {
-                json_object_object_add(additional_info, API_MUSICBRAINZ_SPOTIFY_ID_NODE_NAME, json_object_new_string(track->mb_spotify_id));
+            if (strlen(scrobble_spotify_id(track)) > 0) {
+                json_object_object_add(additional_info, API_MUSICBRAINZ_SPOTIFY_ID_NODE_NAME, json_object_new_string(scrobble_spotify_id(track)));
             }
 
             json_object_object_add(metadata, API_ADDITIONAL_INFO_NODE_NAME, additional_info);
@@ -227,58 +197,45 @@ struct http_request *listenbrainz_api_build_request_scrobble(const struct scrobb
 
     json_object_object_add(root, API_PAYLOAD_NODE_NAME, payload);
 
-    const char *json_str = json_object_to_json_string(root);
-    strncpy(body, json_str, MAX_BODY_SIZE);
+    char *body = grrrs_from_string(json_object_to_json_string(root));
+    if (NULL == body) {
+        json_object_put(root);
+        return NULL;
+    }
 
     struct http_request *request = http_request_new();
     arrput(request->headers, (http_authorization_header_new(token)));
     arrput(request->headers, (http_content_type_header_new()));
 
     request->request_type = http_post;
-    request->query = query;
     request->body = body;
-    request->body_length = strlen(body);
+    request->body_length = grrrs_len(body);
     request->end_point = api_endpoint_new(auth);
     request->url = api_get_url(request->end_point);
-    strncpy(request->url + strlen(request->url), API_ENDPOINT_SUBMIT_LISTEN, strlen(API_ENDPOINT_SUBMIT_LISTEN) + 1);
+    request->url = grrrs_append_cstring(request->url, API_ENDPOINT_SUBMIT_LISTEN);
 
     json_object_put(root);
 
     return request;
 }
 
-bool listenbrainz_json_document_is_error(const char *buffer, const size_t length)
+bool listenbrainz_json_document_is_error(const json_object *root)
 {
     // { "code": 401, "error": "You need to provide an Authorization header." }
-    bool result = false;
-
-    if (NULL == buffer) { return result; }
-    if (length == 0) { return result; }
+    if (NULL == root || json_object_object_length(root) < 1) { return false; }
 
     json_object *code_object = NULL;
     json_object *err_object = NULL;
 
-    struct json_tokener *tokener = json_tokener_new();
-    if (NULL == tokener) { return result; }
-    json_object *root = json_tokener_parse_ex(tokener, buffer, length);
-
-    if (NULL == root || json_object_object_length(root) < 1) {
-        goto _exit;
-    }
     json_object_object_get_ex(root, API_CODE_NODE_NAME, &code_object);
     json_object_object_get_ex(root, API_ERROR_NODE_NAME, &err_object);
     if (NULL == code_object || !json_object_is_type(code_object, json_type_string)) {
-        goto _exit;
+        return false;
     }
     if (NULL == err_object || !json_object_is_type(err_object, json_type_int)) {
-        goto _exit;
+        return false;
     }
-    result = true;
-
-_exit:
-    if (NULL != root) { json_object_put(root); }
-    json_tokener_free(tokener);
-    return result;
+    return true;
 }
 
 #endif // MPRIS_SCROBBLER_LISTENBRAINZ_API_H
@@ -0,0 +1,126 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+#ifndef MPRIS_SCROBBLER_PLAYER_INDEX_H
+#define MPRIS_SCROBBLER_PLAYER_INDEX_H
+
+#define PLAYER_INDEX_INITIAL_CAPACITY   16
+#define PLAYER_INDEX_FNV_OFFSET         2166136261U
+#define PLAYER_INDEX_FNV_PRIME          16777619U
+
+/*
+ * Each player is in the index twice, by its unique bus name, which the signals come from,
+ * and by its well-known MPRIS name. The keys point into the player, so it has to be
+ * removed from the index before it's freed.
+ */
+
+static uint32_t player_index_hash(const char *key)
+{
+    uint32_t hash = PLAYER_INDEX_FNV_OFFSET;
+    for (const unsigned char *c = (const unsigned char*)key; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= PLAYER_INDEX_FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Returns the slot holding the key, or the free one where it would go */
+static struct player_index_slot *player_index_slot(const struct player_index *index, const char *key, uint32_t hash)
+{
+    size_t mask = index->capacity - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        struct player_index_slot *slot = &index->slots[i];
+        if (NULL == slot->key) { return slot; }
+        if (slot->hash == hash && strcmp(slot->key, key) == 0) { return slot; }
+    }
+}
+
+static bool player_index_grow(struct player_index *index)
+{
+    size_t capacity = index->capacity > 0 ? index->capacity * 2 : PLAYER_INDEX_INITIAL_CAPACITY;
+    struct player_index_slot *slots = calloc(capacity, sizeof(struct player_index_slot));
+    if (NULL == slots) { return false; }
+
+    struct player_index old = *index;
+    index->slots = slots;
+    index->capacity = capacity;
+    for (size_t i = 0; i < old.capacity; i++) {
+        if (NULL == old.slots[i].key) { continue; }
+        *player_index_slot(index, old.slots[i].key, old.slots[i].hash) = old.slots[i];
+    }
+    free(old.slots);
+    _trace2("player_index::grown: %zu slots, %zu keys", index->capacity, index->length);
+    return true;
+}
+
+struct mpris_player *player_index_find(const struct player_index *index, const char *key)
+{
+    if (NULL == key || index->length == 0) { return NULL; }
+
+    return player_index_slot(index, key, player_index_hash(key))->player;
+}
+
+/* Adds the key, or points it to the player if it's already there */
+static bool player_index_put(struct player_index *index, const char *key, struct mpris_player *player)
+{
+    if (NULL == key || strlen(key) == 0) { return false; }
+    // kept at most half full, so the probe sequences stay short
+    if ((index->length + 1) * 2 > index->capacity && !player_index_grow(index)) {
+        return false;
+    }
+
+    uint32_t hash = player_index_hash(key);
+    struct player_index_slot *slot = player_index_slot(index, key, hash);
+    if (NULL == slot->key) { index->length++; }
+    slot->key = key;
+    slot->hash = hash;
+    slot->player = player;
+    return true;
+}
+
+/*
+ * Removes the key if it points to the player: a new player can take over the well-known
+ * name before the previous owner is gone. The following slots of the probe sequence are
+ * moved back into the freed one, so no tombstones are needed.
+ */
+static void player_index_del(struct player_index *index, const char *key, const struct mpris_player *player)
+{
+    if (NULL == key || index->length == 0) { return; }
+
+    size_t mask = index->capacity - 1;
+    struct player_index_slot *slot = player_index_slot(index, key, player_index_hash(key));
+    if (NULL == slot->key || slot->player != player) { return; }
+
+    size_t hole = (size_t)(slot - index->slots);
+    for (size_t i = (hole + 1) & mask; NULL != index->slots[i].key; i = (i + 1) & mask) {
+        size_t home = index->slots[i].hash & mask;
+        // the entry can't move back past its home slot
+        if (((i - home) & mask) < ((i - hole) & mask)) { continue; }
+        index->slots[hole] = index->slots[i];
+        hole = i;
+    }
+    memset(&index->slots[hole], 0x0, sizeof(struct player_index_slot));
+    index->length--;
+}
+
+void player_index_add(struct player_index *index, struct mpris_player *player)
+{
+    if (!player_index_put(index, player->bus_id, player)) {
+        _warn("player_index::add_failed: %s", player->bus_id);
+    }
+    player_index_put(index, player->mpris_name, player);
+}
+
+void player_index_remove(struct player_index *index, const struct mpris_player *player)
+{
+    player_index_del(index, player->bus_id, player);
+    player_index_del(index, player->mpris_name, player);
+}
+
+void player_index_clean(struct player_index *index)
+{
+    free(index->slots);
+    memset(index, 0x0, sizeof(struct player_index));
+}
+
+#endif // MPRIS_SCROBBLER_PLAYER_INDEX_H
@@ -0,0 +1,270 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+#ifndef MPRIS_SCROBBLER_QUEUE_H
+#define MPRIS_SCROBBLER_QUEUE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define QUEUE_FILE_NAME             "queue"
+#define QUEUE_INITIAL_CAPACITY      4
+#define QUEUE_HOT_WINDOW            16
+// a multiple of the batch size of all services, so consuming in chunks doesn't add requests
+#define QUEUE_CONSUME_CHUNK         1000
+#define QUEUE_SPILL_FLUSH_SIZE      65536
+
+/*
+ * The scrobble queue is a ring buffer which holds the newest scrobbles in memory.
+ * Once it outgrows the hot window, the oldest scrobbles are paged out to a segment file
+ * from which they're read back in FIFO order when the queue is consumed.
+ *
+ * The segment file is only a cache, the journal is the one which survives restarts.
+ */
+struct queue_spill_record {
+    uint32_t length;
+    uint32_t services;
+    uint64_t id;
+};
+
+size_t scrobble_queue_length(const struct scrobble_queue *q)
+{
+    if (NULL == q) { return 0; }
+    return q->length + q->spill.length;
+}
+
+struct scrobble *scrobble_queue_at(const struct scrobble_queue *q, int pos)
+{
+    if (NULL == q || pos < 0 || pos >= q->length) { return NULL; }
+    return q->entries[(q->head + pos) % q->capacity];
+}
+
+struct scrobble *scrobble_queue_top(const struct scrobble_queue *q)
+{
+    if (NULL == q) { return NULL; }
+    return scrobble_queue_at(q, q->length - 1);
+}
+
+static bool scrobble_queue_flush(struct scrobble_queue *q)
+{
+    if (q->spill.fd < 0 || arrlen(q->spill.buffer) == 0) { return true; }
+
+    bool status = journal_write_all(q->spill.fd, q->spill.buffer, arrlen(q->spill.buffer));
+    if (!status) {
+        _warn("queue::spill:write_failed: %s", strerror(errno));
+    }
+    journal_reset(&q->spill.buffer);
+    return status;
+}
+
+static void scrobble_queue_spill(struct scrobble_queue *q, const struct scrobble *track)
+{
+    struct queue_spill_record rec = {
+        .services = track->journal_services,
+        .id = track->journal_id,
+    };
+    size_t offset = arrlen(q->spill.buffer);
+    journal_put(&q->spill.buffer, &rec, sizeof(rec));
+    journal_serialize_scrobble(&q->spill.buffer, track);
+
+    rec.length = arrlen(q->spill.buffer) - offset - sizeof(rec);
+    memcpy(q->spill.buffer + offset, &rec, sizeof(rec));
+    q->spill.length++;
+
+    if (arrlen(q->spill.buffer) >= QUEUE_SPILL_FLUSH_SIZE) {
+        scrobble_queue_flush(q);
+    }
+}
+
+static void scrobble_queue_grow(struct scrobble_queue *q)
+{
+    int capacity = q->capacity > 0 ? q->capacity * 2 : QUEUE_INITIAL_CAPACITY;
+    struct scrobble **entries = calloc(capacity, sizeof(struct scrobble*));
+    assert(NULL != entries);
+
+    // unwrap the ring while moving it
+    for (int i = 0; i < q->length; i++) {
+        entries[i] = scrobble_queue_at(q, i);
+    }
+    free(q->entries);
+    q->entries = entries;
+    q->capacity = capacity;
+    q->head = 0;
+    _trace2("queue::grow: %d", capacity);
+}
+
+/*
+ * Adds the scrobble as the newest in the queue, which takes ownership of it
+ */
+void scrobble_queue_push(struct scrobble_queue *q, struct scrobble *track)
+{
+    assert(NULL != q);
+    assert(NULL != track);
+
+    if (q->length == q->capacity) {
+        if (q->capacity >= QUEUE_HOT_WINDOW && q->spill.fd >= 0) {
+            // page out the oldest scrobble to make room
+            struct scrobble *oldest = q->entries[q->head];
+            scrobble_queue_spill(q, oldest);
+            scrobble_free(oldest);
+            q->entries[q->head] = NULL;
+            q->head = (q->head + 1) % q->capacity;
+            q->length--;
+        } else {
+            scrobble_queue_grow(q);
+        }
+    }
+
+    q->entries[(q->head + q->length) % q->capacity] = track;
+    q->length++;
+}
+
+/*
+ * Drops the in memory scrobbles, optionally keeping the newest one
+ */
+void scrobble_queue_clear(struct scrobble_queue *q, bool keep_top)
+{
+    if (NULL == q || q->length == 0) { return; }
+
+    struct scrobble *top = scrobble_queue_top(q);
+    int count = keep_top ? q->length - 1 : q->length;
+    for (int i = 0; i < count; i++) {
+        int idx = (q->head + i) % q->capacity;
+        scrobble_free(q->entries[idx]);
+        q->entries[idx] = NULL;
+    }
+    if (keep_top) {
+        q->entries[(q->head + q->length - 1) % q->capacity] = NULL;
+        q->entries[0] = top;
+    }
+    q->head = 0;
+    q->length = keep_top ? 1 : 0;
+}
+
+/*
+ * Loads up to max_count of the oldest, paged out, scrobbles, removing them from the segment file
+ * The loaded scrobbles belong to the caller.
+ * Returns the number of loaded scrobbles
+ */
+size_t scrobble_queue_read_spilled(struct scrobble_queue *q, struct scrobble *tracks[], size_t max_count)
+{
+    if (NULL == q || q->spill.length == 0) { return 0; }
+    if (!scrobble_queue_flush(q)) { return 0; }
+
+    size_t count = 0;
+    bool failed = false;
+    char *payload = NULL;
+    while (count < max_count && q->spill.length > 0) {
+        struct queue_spill_record rec;
+        if (pread(q->spill.fd, &rec, sizeof(rec), q->spill.read_offset) != sizeof(rec)) {
+            failed = true;
+            break;
+        }
+        journal_reset(&payload);
+        arraddn(payload, rec.length);
+        if (pread(q->spill.fd, payload, rec.length, q->spill.read_offset + sizeof(rec)) != (ssize_t)rec.length) {
+            failed = true;
+            break;
+        }
+        q->spill.read_offset += sizeof(rec) + rec.length;
+        q->spill.length--;
+
+        struct scrobble *track = journal_deserialize_scrobble(payload, rec.length);
+        if (NULL == track) {
+            _warn("queue::spill:invalid_entry %" PRIu64, rec.id);
+            continue;
+        }
+        track->journal_id = rec.id;
+        track->journal_services = rec.services;
+        tracks[count] = track;
+        count++;
+    }
+    if (NULL != payload) { arrfree(payload); }
+
+    if (q->spill.length == 0 || failed) {
+        if (failed) {
+            _warn("queue::spill:unable to read, dropping %zu scrobbles", q->spill.length);
+        }
+        // either drained, or unreadable: start the segment over
+        if (ftruncate(q->spill.fd, 0) != 0) {
+            _warn("queue::spill:unable to truncate: %s", strerror(errno));
+        }
+        q->spill.read_offset = 0;
+        q->spill.length = 0;
+    }
+    _trace("queue::spill:loaded %zu, remaining %zu", count, q->spill.length);
+    return count;
+}
+
+/*
+ * Appends the journal ids of the queued scrobbles, the paged out ones included
+ */
+void scrobble_queue_journal_ids(struct scrobble_queue *q, uint64_t **ids)
+{
+    if (NULL == q) { return; }
+
+    for (int pos = 0; pos < q->length; pos++) {
+        const struct scrobble *track = scrobble_queue_at(q, pos);
+        if (NULL != track && track->journal_id != 0) {
+            arrput(*ids, track->journal_id);
+        }
+    }
+    if (q->spill.length == 0 || !scrobble_queue_flush(q)) { return; }
+
+    // only the record headers are read
+    off_t offset = q->spill.read_offset;
+    for (size_t i = 0; i < q->spill.length; i++) {
+        struct queue_spill_record rec;
+        if (pread(q->spill.fd, &rec, sizeof(rec), offset) != sizeof(rec)) { break; }
+        if (rec.id != 0) {
+            arrput(*ids, rec.id);
+        }
+        offset += sizeof(rec) + rec.length;
+    }
+}
+
+void scrobble_queue_init(struct scrobble_queue *q, const char *spill_path)
+{
+    assert(NULL != q);
+
+    memset(q, 0x0, sizeof(*q));
+    q->spill.fd = -1;
+    if (NULL == spill_path) { return; }
+
+    q->spill.path = grrrs_from_string(spill_path);
+    journal_create_folder(q->spill.path);
+    q->spill.fd = open(q->spill.path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR);
+    if (q->spill.fd < 0) {
+        _warn("queue::spill:unable to open %s, keeping all scrobbles in memory: %s", q->spill.path, strerror(errno));
+    }
+}
+
+void scrobble_queue_free(struct scrobble_queue *q)
+{
+    if (NULL == q) { return; }
+
+    if (q->spill.fd >= 0) {
+        close(q->spill.fd);
+        unlink(q->spill.path);
+        q->spill.fd = -1;
+    }
+    if (NULL != q->spill.path) {
+        grrrs_free(q->spill.path);
+        q->spill.path = NULL;
+    }
+    if (NULL != q->spill.buffer) {
+        arrfree(q->spill.buffer);
+        q->spill.buffer = NULL;
+    }
+    scrobble_queue_clear(q, false);
+    if (NULL != q->entries) {
+        free(q->entries);
+        q->entries = NULL;
+    }
+    q->capacity = 0;
+    q->length = 0;
+    q->head = 0;
+}
+
+#endif // MPRIS_SCROBBLER_QUEUE_H
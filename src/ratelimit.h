@@ -0,0 +1,125 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+#ifndef MPRIS_SCROBBLER_RATELIMIT_H
+#define MPRIS_SCROBBLER_RATELIMIT_H
+
+#include <time.h>
+
+#define RATE_LIMIT_DEFAULT          1.0 // requests per second
+#define RATE_BURST_DEFAULT          5
+
+/*
+ * A token bucket for each service: a request takes a token, and the tokens refill at rate_limit
+ * per second, up to rate_burst. The requests that find the bucket empty wait, in order, for the
+ * next tokens. The ones cancelled while waiting (eg, an outdated now playing) are skipped.
+ */
+
+uint64_t scrobbler_connection_handle(const struct scrobbler_connection*);
+struct scrobbler_connection *scrobbler_connection_lookup(const struct scrobbler*, uint64_t);
+
+static double monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+}
+
+static void bucket_refill(struct scrobbler_bucket *b)
+{
+    const struct scrobbler *s = b->parent;
+    double now = monotonic_seconds();
+    b->tokens += (now - b->refilled_at) * s->rate_limit;
+    if (b->tokens > s->rate_burst) { b->tokens = s->rate_burst; }
+    b->refilled_at = now;
+}
+
+/* Arms the timer for when the next token is available */
+static void bucket_schedule(struct scrobbler_bucket *b)
+{
+    if (arrlen(b->waiting) == 0 || evtimer_pending(&b->event, NULL)) { return; }
+
+    double wait = (1.0 - b->tokens) / b->parent->rate_limit;
+    if (wait < 0) { wait = 0; }
+    struct timeval timeout = {
+        .tv_sec = (time_t)wait,
+        .tv_usec = (suseconds_t)((wait - (double)(time_t)wait) * 1000000),
+    };
+    evtimer_add(&b->event, &timeout);
+    _trace("ratelimit::scheduled[%s]: %zd waiting, in %2.2lfs", get_api_type_label(b->end_point), arrlen(b->waiting), timeval_to_seconds(timeout));
+}
+
+static void bucket_cb(int fd, short kind, void *data)
+{
+    assert(data);
+    struct scrobbler_bucket *b = data;
+    struct scrobbler *s = b->parent;
+
+    bucket_refill(b);
+    int sent = 0;
+    int waiting_count = arrlen(b->waiting);
+    for (; sent < waiting_count && b->tokens >= 1.0; sent++) {
+        struct scrobbler_connection *conn = scrobbler_connection_lookup(s, b->waiting[sent]);
+        // the requests freed while waiting don't take a token
+        if (NULL == conn) { continue; }
+        b->tokens -= 1.0;
+        // the service might have become unavailable while the request was waiting
+        if (retry_hold(&s->retries[b->end_point], conn)) {
+            continue;
+        }
+        curl_multi_add_handle(s->handle, conn->handle);
+    }
+    if (sent > 0) {
+        arrdeln(b->waiting, 0, sent);
+    }
+    _trace("ratelimit::released[%s]: %d requests, %zd waiting", get_api_type_label(b->end_point), sent, arrlen(b->waiting));
+    bucket_schedule(b);
+}
+
+void bucket_init(struct scrobbler_bucket *b, struct scrobbler *s, enum api_type end_point)
+{
+    b->parent = s;
+    b->end_point = end_point;
+    b->tokens = s->rate_burst;
+    b->refilled_at = monotonic_seconds();
+    b->waiting = NULL;
+    b->throttled = 0;
+    evtimer_assign(&b->event, s->evbase, bucket_cb, b);
+}
+
+/* The connections are owned by the scrobbler, only the list of waiting ones is freed */
+void bucket_clean(struct scrobbler_bucket *b)
+{
+    if (b->throttled > 0) {
+        _info("ratelimit::stats[%s]: throttled %zu", get_api_type_label(b->end_point), b->throttled);
+    }
+    if (evtimer_initialized(&b->event) && evtimer_pending(&b->event, NULL)) {
+        evtimer_del(&b->event);
+    }
+    arrfree(b->waiting);
+    b->waiting = NULL;
+}
+
+/*
+ * Takes a token for the request, or puts it on the waiting list when there are none left,
+ * returns false if it can be sent right away
+ */
+bool bucket_hold(struct scrobbler_bucket *b, struct scrobbler_connection *conn)
+{
+    struct scrobbler *s = b->parent;
+    if (s->rate_limit <= 0) { return false; }
+
+    bucket_refill(b);
+    if (arrlen(b->waiting) == 0 && b->tokens >= 1.0) {
+        b->tokens -= 1.0;
+        return false;
+    }
+
+    b->throttled++;
+    arrput(b->waiting, scrobbler_connection_handle(conn));
+    _debug("ratelimit::throttled[%s]: %zd waiting", get_api_type_label(b->end_point), arrlen(b->waiting));
+    bucket_schedule(b);
+    return true;
+}
+
+#endif // MPRIS_SCROBBLER_RATELIMIT_H
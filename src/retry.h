@@ -0,0 +1,312 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+#ifndef MPRIS_SCROBBLER_RETRY_H
+#define MPRIS_SCROBBLER_RETRY_H
+
+#include <ctype.h>
+#include <time.h>
+#include <curl/curl.h>
+
+#define MAX_RETRIES                 5
+#define RETRY_BASE_SECONDS          3
+#define RETRY_MAX_SECONDS           900 // seconds
+#define RETRY_AFTER_HEADER_NAME     "Retry-After"
+#define BREAKER_FAILURE_THRESHOLD   3 // failed waves
+
+/*
+ * The requests that failed because a service is unavailable wait for it together:
+ *  - the first failure arms the timer of the service, with the delay from the Retry-After
+ *  header, or an exponential backoff with jitter based on the consecutive failures
+ *  - the following failures and the new requests join the waiting list
+ *  - when the timer fires only one request is sent, to check the service
+ *  - once the service responds, all the waiting requests are sent at once
+ *
+ * After BREAKER_FAILURE_THRESHOLD failed waves the circuit breaker of the service opens:
+ *  - the now playing requests are dropped, and the scrobbles are left in the journal
+ *  - only one request is kept, and is sent as the probe (half open) when the timer fires
+ *  - once the probe gets through the breaker closes, and the backlog is replayed from the journal
+ */
+
+static void scrobbler_connection_del(struct scrobbler*, int);
+uint64_t scrobbler_connection_handle(const struct scrobbler_connection*);
+struct scrobbler_connection *scrobbler_connection_lookup(const struct scrobbler*, uint64_t);
+void scrobbler_replay_backlog(struct scrobbler*, enum api_type);
+
+static const char *breaker_state_label(enum breaker_state state)
+{
+    switch (state) {
+        case breaker_closed:
+            return "closed";
+        case breaker_open:
+            return "open";
+        case breaker_half_open:
+            return "half-open";
+    }
+    return "unknown";
+}
+
+static void breaker_set_state(struct scrobbler_retry *r, enum breaker_state state)
+{
+    if (r->state == state) { return; }
+    // the probes flip between open and half open, only opening and closing are worth reporting
+    enum log_levels level = (state == breaker_closed || r->state == breaker_closed) ? log_info : log_debug;
+    _log(level, "breaker::%s[%s]: was %s", breaker_state_label(state), get_api_type_label(r->end_point), breaker_state_label(r->state));
+    r->state = state;
+}
+
+/*
+ * The request can be dropped while the breaker is open: now playing updates are outdated by the time
+ * the service comes back, and the scrobbles are replayed from the journal.
+ */
+static bool connection_droppable(const struct scrobbler *s, const struct scrobbler_connection *conn)
+{
+    return conn->now_playing || s->journal.fd >= 0;
+}
+
+/*
+ * Drops all the waiting requests which can be dropped, but the one kept for probing the service
+ */
+static void breaker_trip(struct scrobbler_retry *r)
+{
+    struct scrobbler *s = r->parent;
+    breaker_set_state(r, breaker_open);
+
+    int waiting_count = arrlen(r->waiting);
+    int kept = 0;
+    for (int i = 0; i < waiting_count; i++) {
+        struct scrobbler_connection *conn = scrobbler_connection_lookup(s, r->waiting[i]);
+        if (NULL == conn) { continue; }
+        if (kept > 0 && connection_droppable(s, conn)) {
+            scrobbler_connection_del(s, conn->idx);
+            continue;
+        }
+        r->waiting[kept] = r->waiting[i];
+        kept++;
+    }
+    arrsetlen(r->waiting, (size_t)kept);
+    _debug("breaker::dropped[%s]: %d requests", get_api_type_label(r->end_point), waiting_count - kept);
+}
+
+/*
+ * While the breaker isn't closed the now playing requests are dropped, and the scrobbles
+ * stay in the journal, if there's one to keep them.
+ */
+bool retry_allows_request(const struct scrobbler_retry *r, bool now_playing)
+{
+    if (r->state == breaker_closed) { return true; }
+    return !now_playing && r->parent->journal.fd < 0;
+}
+
+/*
+ * Returns the seconds to wait from the Retry-After header, which is either a number
+ * of seconds or an HTTP date, or -1 when the response doesn't have one
+ */
+long http_response_retry_after(const struct http_response *res)
+{
+    const char *value = http_response_get_header(res, RETRY_AFTER_HEADER_NAME);
+    if (NULL == value) { return -1; }
+
+    char *end = NULL;
+    long seconds = strtol(value, &end, 10);
+    if (end != value && (*end == '\0' || isspace((unsigned char)*end))) {
+        return seconds > 0 ? seconds : 0;
+    }
+
+    time_t date = curl_getdate(value, NULL);
+    if (date == -1) { return -1; }
+    time_t now = time(NULL);
+    return date > now ? (long)(date - now) : 0;
+}
+
+/*
+ * Exponential backoff with "equal jitter": half of the delay is fixed, the other half random,
+ * so the requests of clients which failed at the same time don't come back at the same time
+ */
+static struct timeval retry_backoff(unsigned failures)
+{
+    long seconds = RETRY_BASE_SECONDS;
+    for (unsigned i = 0; i < failures && seconds < RETRY_MAX_SECONDS; i++) {
+        seconds *= 2;
+    }
+    if (seconds > RETRY_MAX_SECONDS) { seconds = RETRY_MAX_SECONDS; }
+
+    uint32_t jitter = 0;
+    evutil_secure_rng_get_bytes(&jitter, sizeof(jitter));
+
+    uint64_t half = (uint64_t)seconds * 1000000 / 2;
+    uint64_t delay = half + jitter % (half + 1);
+    struct timeval result = {
+        .tv_sec = (time_t)(delay / 1000000),
+        .tv_usec = (suseconds_t)(delay % 1000000),
+    };
+    return result;
+}
+
+/* Sends one of the waiting requests to check if the service is back */
+static void retry_cb(int fd, short kind, void *data)
+{
+    assert(data);
+    struct scrobbler_retry *r = data;
+
+    struct scrobbler_connection *conn = NULL;
+    while (NULL == conn && arrlen(r->waiting) > 0) {
+        // the requests freed while waiting are skipped
+        conn = scrobbler_connection_lookup(r->parent, r->waiting[0]);
+        arrdel(r->waiting, 0);
+    }
+    if (NULL == conn) { return; }
+    if (r->state == breaker_open) {
+        breaker_set_state(r, breaker_half_open);
+    }
+    _debug("retry::probe[%s]: %zd waiting", get_api_type_label(r->end_point), arrlen(r->waiting));
+    curl_multi_add_handle(r->parent->handle, conn->handle);
+}
+
+void retry_init(struct scrobbler_retry *r, struct scrobbler *s, enum api_type end_point)
+{
+    r->parent = s;
+    r->end_point = end_point;
+    r->failures = 0;
+    r->state = breaker_closed;
+    r->waiting = NULL;
+    evtimer_assign(&r->event, s->evbase, retry_cb, r);
+}
+
+/* The connections are owned by the scrobbler, only the list of waiting ones is freed */
+void retry_clean(struct scrobbler_retry *r)
+{
+    if (evtimer_initialized(&r->event) && evtimer_pending(&r->event, NULL)) {
+        evtimer_del(&r->event);
+    }
+    arrfree(r->waiting);
+    r->waiting = NULL;
+}
+
+static bool retry_backing_off(const struct scrobbler_retry *r)
+{
+    return arrlen(r->waiting) > 0;
+}
+
+/*
+ * Puts a new request on the waiting list if the service is unavailable,
+ * returns false if it can be sent right away
+ */
+bool retry_hold(struct scrobbler_retry *r, struct scrobbler_connection *conn)
+{
+    if (!retry_backing_off(r)) { return false; }
+
+    arrput(r->waiting, scrobbler_connection_handle(conn));
+    _debug("retry::hold[%s]: %zd waiting", get_api_type_label(r->end_point), arrlen(r->waiting));
+    return true;
+}
+
+/*
+ * Arms the timer of the service for the waiting requests. When it's already armed the failed
+ * request joins the waiting ones, and only a later Retry-After from the service pushes it back.
+ */
+static void retry_schedule(struct scrobbler_retry *r, long retry_after)
+{
+    if (!retry_backing_off(r)) { return; }
+
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = 0, };
+    if (retry_after >= 0) {
+        timeout.tv_sec = retry_after < RETRY_MAX_SECONDS ? retry_after : RETRY_MAX_SECONDS;
+    } else {
+        timeout = retry_backoff(r->failures);
+    }
+
+    struct timeval pending;
+    if (evtimer_pending(&r->event, &pending)) {
+        if (retry_after < 0) { return; }
+
+        struct timeval now;
+        event_base_gettimeofday_cached(r->parent->evbase, &now);
+        if (timeval_to_seconds(now) + timeval_to_seconds(timeout) <= timeval_to_seconds(pending)) {
+            return;
+        }
+    } else {
+        r->failures++;
+        if (r->state == breaker_closed && r->failures >= BREAKER_FAILURE_THRESHOLD) {
+            breaker_trip(r);
+        }
+    }
+
+    evtimer_add(&r->event, &timeout);
+    _debug("retry::scheduled[%s]: %zd waiting, in %2.2lfs", get_api_type_label(r->end_point), arrlen(r->waiting), timeval_to_seconds(timeout));
+}
+
+/* The service responded, all the waiting requests go out */
+static void retry_release(struct scrobbler_retry *r)
+{
+    r->failures = 0;
+    if (!retry_backing_off(r)) { return; }
+
+    if (evtimer_pending(&r->event, NULL)) {
+        evtimer_del(&r->event);
+    }
+    int waiting_count = arrlen(r->waiting);
+    _debug("retry::release[%s]: %zd requests", get_api_type_label(r->end_point), waiting_count);
+    for (int i = 0; i < waiting_count; i++) {
+        struct scrobbler_connection *conn = scrobbler_connection_lookup(r->parent, r->waiting[i]);
+        if (NULL == conn) { continue; }
+        curl_multi_add_handle(r->parent->handle, conn->handle);
+    }
+    arrfree(r->waiting);
+    r->waiting = NULL;
+}
+
+/*
+ * The request didn't get a response, or got one saying the service can't handle it now
+ */
+bool connection_service_unavailable(const struct scrobbler_connection *conn)
+{
+    int code = conn->response->code;
+    return code < 100 || code == 429 || code >= 500;
+}
+
+/*
+ * Called for a finished request: if the service was unavailable the request waits to be retried,
+ * otherwise it's removed, and the requests waiting for the service are released.
+ */
+void retry_connection_done(struct scrobbler *s, struct scrobbler_connection *conn)
+{
+    struct scrobbler_retry *r = &s->retries[conn->credentials.end_point];
+
+    if (!connection_service_unavailable(conn)) {
+        scrobbler_connection_del(s, conn->idx);
+        bool was_closed = r->state == breaker_closed;
+        breaker_set_state(r, breaker_closed);
+        retry_release(r);
+        if (!was_closed) {
+            scrobbler_replay_backlog(s, r->end_point);
+        }
+        return;
+    }
+
+    if (r->state == breaker_half_open) {
+        breaker_set_state(r, breaker_open);
+    }
+    bool keep = conn->retries < MAX_RETRIES;
+    if (r->state != breaker_closed) {
+        // while the breaker is open only the probe is kept, and the requests nothing else holds
+        keep = arrlen(r->waiting) == 0 || !connection_droppable(s, conn);
+    }
+
+    long retry_after = http_response_retry_after(conn->response);
+    if (keep) {
+        curl_multi_remove_handle(s->handle, conn->handle);
+        http_response_clean(conn->response);
+        memset(conn->error, 0x0, CURL_ERROR_SIZE);
+        conn->retries++;
+        arrput(r->waiting, scrobbler_connection_handle(conn));
+    } else {
+        if (r->state == breaker_closed) {
+            _warn("retry::giving_up[%s]: after %zd retries", get_api_type_label(r->end_point), conn->retries);
+        }
+        scrobbler_connection_del(s, conn->idx);
+    }
+    retry_schedule(r, retry_after);
+}
+
+#endif // MPRIS_SCROBBLER_RETRY_H
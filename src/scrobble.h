@@ -9,9 +9,10 @@
 
 #define NOW_PLAYING_DELAY 65.0L //seconds
 #define MIN_TRACK_LENGTH  30.0F // seconds
+#define DEBOUNCE_DEFAULT  150 // ms
 #define MPRIS_SPOTIFY_TRACK_ID_PREFIX                          "spotify:track:"
 
-int load_player_namespaces(DBusConnection *, struct mpris_player *, int);
+struct mpris_player **load_player_namespaces(DBusConnection *);
 void load_player_mpris_properties(DBusConnection*, struct mpris_player*);
 
 struct dbus *dbus_connection_init(struct state*);
@@ -24,7 +25,7 @@ static inline bool mpris_event_changed_position(const struct mpris_event *);
 static void debug_event(const struct mpris_event *e)
 {
     enum log_levels level = log_debug;
-    _log(log_tracing2, "scrobbler::player:                           %7s", e->sender_bus_id);
+    _log(log_tracing2, "scrobbler::player:                           %7s", _str(e->sender_bus_id));
     _log(log_tracing2, "change ::at:          %11d", e->timestamp);
     _log(level, "changed::volume:          %7s", _to_bool(mpris_event_changed_volume(e)));
     _log(level, "changed::position:        %7s", _to_bool(mpris_event_changed_position(e)));
@@ -162,32 +163,22 @@ double min_scrobble_seconds(const struct scrobble *s)
     return max(result, 0.0);
 }
 
-static void scrobble_init(struct scrobble *s)
-{
-    if (NULL == s) { return; }
-    s->scrobbled = false;
-    s->length = 0;
-    s->position = 0;
-    s->start_time = 0;
-    s->track_number = 0;
-    s->play_time = 0UL;
-
-    _trace2("mem::inited_scrobble(%p)", s);
-}
-
-struct scrobble *scrobble_new(void)
-{
-    struct scrobble *result = malloc(sizeof(struct scrobble));
-    scrobble_init(result);
-
-    return result;
-}
-
-static void scrobble_init(struct scrobble*);
+static void player_properties_match(struct mpris_player*, bool);
 static void mpris_player_free(struct mpris_player *player)
 {
     if (NULL == player) { return; }
 
+    player_properties_match(player, false);
+    // the player went away before replying
+    if (NULL != player->identity_call) {
+        dbus_pending_call_cancel(player->identity_call);
+        dbus_pending_call_unref(player->identity_call);
+    }
+    if (NULL != player->properties_call) {
+        dbus_pending_call_cancel(player->properties_call);
+        dbus_pending_call_unref(player->properties_call);
+    }
+
     if (NULL != player->history) {
         int hist_size = arrlen(player->history);
         for(int i = 0; i < hist_size; i++) {
@@ -200,19 +191,29 @@ static void mpris_player_free(struct mpris_player *player)
     if (event_initialized(&player->queue.event) && event_pending(&player->queue.event, EV_TIMEOUT, NULL)) {
         event_del(&player->queue.event);
     }
-    memset(player, 0x0, sizeof(*player));
+    if (event_initialized(&player->debounce) && evtimer_pending(&player->debounce, NULL)) {
+        evtimer_del(&player->debounce);
+    }
+    scrobble_free(player->now_playing.scrobble);
+    scrobble_free(player->queue.scrobble);
+    arena_free(&player->properties.strings);
+    arena_free(&player->properties.spare);
+    free(player);
 }
 
 void events_free(struct events*);
 void dbus_close(struct state*);
+void player_index_clean(struct player_index*);
 void state_destroy(struct state *s)
 {
-    if (NULL != s->dbus) { dbus_close(s); }
-    for (int i = 0; i < s->player_count; i++) {
-        mpris_player_free(&s->players[i]);
+    player_index_clean(&s->player_names);
+    // the players can still have calls pending on the connection
+    for (int i = 0; i < arrlen(s->players); i++) {
+        mpris_player_free(s->players[i]);
     }
+    arrfree(s->players);
+    if (NULL != s->dbus) { dbus_close(s); }
 
-    curl_multi_cleanup(s->scrobbler.handle);
     scrobbler_clean(&s->scrobbler);
     events_free(&s->events);
 }
@@ -225,8 +226,13 @@ static struct mpris_player *mpris_player_new(void)
 }
 
 void state_loaded_properties(DBusConnection *, struct mpris_player *, struct mpris_properties *, const struct mpris_event *);
-static void get_player_identity(DBusConnection*, const char*, char*);
-static int mpris_player_init (struct dbus *dbus, struct mpris_player *player, struct events events, struct scrobbler *scrobbler, const char ignored[MAX_PLAYERS][MAX_PROPERTY_LENGTH], int ignored_count)
+static void load_player_identity(DBusConnection*, const char*, struct mpris_player*);
+/*
+ * Asks the player for its name and properties, without waiting for the replies:
+ * they're loaded by mpris_player_loaded when they arrive
+ */
+static void mpris_player_debounced(int, short, void*);
+static int mpris_player_init (struct dbus *dbus, struct mpris_player *player, struct events events, struct scrobbler *scrobbler, const struct configuration *config)
 {
     if (strlen(player->mpris_name) == 0 || strlen(player->bus_id) == 0) {
         return -1;
@@ -235,10 +241,38 @@ static int mpris_player_init (struct dbus *dbus, struct mpris_player *player, st
     if (strlen(identity) == 0) {
         identity = player->bus_id;
     }
-    get_player_identity(dbus->conn, identity, player->name);
+    assert(scrobbler);
+    player->scrobbler = scrobbler;
+    assert(events.base);
+    player->evbase = events.base;
+    player->conn = dbus->conn;
+    assert(config);
+    player->config = config;
+    evtimer_assign(&player->debounce, player->evbase, mpris_player_debounced, player);
+
+    player->now_playing.parent = player;
+    player->queue.parent = player;
+
+    // subscribed first, so no change is missed between loading the properties and the signals
+    player_properties_match(player, true);
+    load_player_identity(dbus->conn, identity, player);
+    load_player_mpris_properties(dbus->conn, player);
+    if (NULL == player->identity_call && NULL == player->properties_call) {
+        return -1;
+    }
+
+    return 1;
+}
 
-    for (int j = 0; j < ignored_count; j++) {
-        char *ignored_id = (char*)ignored[j];
+/*
+ * Called for each reply to the calls made by mpris_player_init, the player is loaded after the last one
+ */
+static void mpris_player_loaded(struct mpris_player *player)
+{
+    if (NULL != player->identity_call || NULL != player->properties_call) { return; }
+
+    for (int j = 0; j < player->config->ignore_players_count; j++) {
+        const char *ignored_id = player->config->ignore_players[j];
         int len = strlen(ignored_id);
         player->ignored = (
             strncmp(player->mpris_name, ignored_id, len) == 0 ||
@@ -246,46 +280,74 @@ static int mpris_player_init (struct dbus *dbus, struct mpris_player *player, st
         );
         if (player->ignored) {
             _debug("mpris_player::ignored: %s on %s", player->name, ignored_id);
-            return 0;
+            player_properties_match(player, false);
+            return;
         }
     }
-    assert(scrobbler);
-    player->scrobbler = scrobbler;
-    assert(events.base);
-    player->evbase = events.base;
+    _debug("mpris_player::loaded: %s%s", player->name, player->bus_id);
+    if (mpris_player_is_valid(player)) {
+        state_loaded_properties(player->conn, player, &player->properties, &player->changed);
+    }
+}
 
-    load_player_mpris_properties(dbus->conn, player);
+/*
+ * The changes of the signals received during the debounce window were gathered in player->changed,
+ * they're handled together so a track change makes for a single now playing
+ */
+static void mpris_player_debounced(int fd, short kind, void *data)
+{
+    assert(data);
+    struct mpris_player *player = data;
 
-    player->now_playing.parent = player;
-    player->queue.parent = player;
+    _trace("mpris_player::debounced[%s]: %u", player->name, player->changed.loaded_state);
+    if (mpris_player_is_valid(player)) {
+        state_loaded_properties(player->conn, player, &player->properties, &player->changed);
+    }
+}
 
-    return 1;
+/*
+ * Called for each PropertiesChanged signal of the player, once its changes are in player->changed
+ */
+static void mpris_player_changed(struct mpris_player *player)
+{
+    int window = player->config->debounce;
+    if (window <= 0) {
+        mpris_player_debounced(-1, EV_TIMEOUT, player);
+        return;
+    }
+    // the window starts with the first signal, so a player which keeps signaling still gets handled
+    if (evtimer_pending(&player->debounce, NULL)) { return; }
+
+    struct timeval timeout = { .tv_sec = window / 1000, .tv_usec = (window % 1000) * 1000, };
+    evtimer_add(&player->debounce, &timeout);
 }
 
 static void print_mpris_player(const struct mpris_player *, enum log_levels, bool);
-static int mpris_players_init(struct dbus *dbus, struct mpris_player *players, struct events events, struct scrobbler *scrobbler, const char ignored[MAX_PLAYERS][MAX_PROPERTY_LENGTH], int ignored_count)
+/*
+ * Returns the players currently on the bus, ignored ones included, so their signals can be skipped
+ */
+static struct mpris_player **mpris_players_init(struct dbus *dbus, struct events events, struct scrobbler *scrobbler, const struct configuration *config)
 {
-    if (NULL == players){
-        return -1;
-    }
     if (NULL == dbus){
         _error("players::init: failed, unable to load from dbus");
-        return -1;
+        return NULL;
     }
-    int player_count = load_player_namespaces(dbus->conn, players, MAX_PLAYERS);
-    int loaded_player_count = 0;
-    for (int i = 0; i < player_count; i++) {
-        struct mpris_player *player = &players[i];
+    struct mpris_player **found = load_player_namespaces(dbus->conn);
+    struct mpris_player **players = NULL;
+    for (int i = 0; i < arrlen(found); i++) {
+        struct mpris_player *player = found[i];
         _trace("mpris_player[%d]: %s %s", i, player->mpris_name, player->bus_id);
-        if (!mpris_player_init(dbus, player, events, scrobbler, ignored, ignored_count)) {
+        if (mpris_player_init(dbus, player, events, scrobbler, config) < 0) {
             _trace("mpris_player[%d:%s]: failed to load properties", i, player->mpris_name);
+            mpris_player_free(player);
             continue;
         }
         print_mpris_player(player, log_tracing2, false);
-        loaded_player_count++;
+        arrput(players, player);
     }
+    arrfree(found);
 
-    return loaded_player_count;
+    return players;
 }
 
 static void print_scrobble(const struct scrobble *s, enum log_levels log)
@@ -294,34 +356,35 @@ static void print_scrobble(const struct scrobble *s, enum log_levels log)
     double d = difftime(now, s->start_time);
 
     char temp[MAX_PROPERTY_LENGTH*MAX_PROPERTY_COUNT+9] = {0};
-    array_log_with_label(temp, s->artist, array_count(s->artist));
+    scrobble_field_log(temp, s, scrobble_field_artist);
     _log(log, "scrobbler::loaded_scrobble(%p)", d);
-    _log(log, "  scrobble::title: %s", s->title);
+    _log(log, "  scrobble::title: %s", scrobble_title(s));
     _log(log, "  scrobble::artist: %s", temp);
-    _log(log, "  scrobble::album: %s", s->album);
+    _log(log, "  scrobble::album: %s", scrobble_album(s));
     _log(log, "  scrobble::length: %lu", s->length);
     _log(log, "  scrobble::position: %.2f", s->position);
     _log(log, "  scrobble::scrobbled: %s", s->scrobbled ? "yes" : "no");
     _log(log, "  scrobble::track_number: %u", s->track_number);
+    _log(log, "  scrobble::fingerprint: %016" PRIx64, s->fingerprint);
     _log(log, "  scrobble::start_time: %lu", s->start_time);
     _log(log, "  scrobble::play_time[%.3lf]: %.3lf", d, s->play_time);
-    if (strlen(s->mb_spotify_id) > 0) {
-        _log(log, "  scrobble::spotify_id: %s", s->mb_spotify_id);
+    if (scrobble_has(s, scrobble_field_spotify_id)) {
+        _log(log, "  scrobble::spotify_id: %s", scrobble_spotify_id(s));
     }
-    if (strlen(s->mb_track_id[0]) > 0) {
-        array_log_with_label(temp, s->mb_track_id, array_count(s->mb_track_id));
+    if (scrobble_has(s, scrobble_field_mb_track_id)) {
+        scrobble_field_log(temp, s, scrobble_field_mb_track_id);
         _log(log, "  scrobble::musicbrainz::track_id: %s", temp);
     }
-    if (strlen(s->mb_artist_id[0]) > 0) {
-        array_log_with_label(temp, s->mb_artist_id, array_count(s->mb_artist_id));
+    if (scrobble_has(s, scrobble_field_mb_artist_id)) {
+        scrobble_field_log(temp, s, scrobble_field_mb_artist_id);
         _log(log, "  scrobble::musicbrainz::artist_id: %s", temp);
     }
-    if (strlen(s->mb_album_id[0]) > 0) {
-        array_log_with_label(temp, s->mb_album_id, array_count(s->mb_album_id));
+    if (scrobble_has(s, scrobble_field_mb_album_id)) {
+        scrobble_field_log(temp, s, scrobble_field_mb_album_id);
         _log(log, "  scrobble::musicbrainz::album_id: %s", temp);
     }
-    if (strlen(s->mb_album_artist_id[0]) > 0) {
-        array_log_with_label(temp, s->mb_album_artist_id, array_count(s->mb_album_artist_id));
+    if (scrobble_has(s, scrobble_field_mb_album_artist_id)) {
+        scrobble_field_log(temp, s, scrobble_field_mb_album_artist_id);
         _log(log, "  scrobble::musicbrainz::album_artist_id: %s", temp);
     }
 }
@@ -331,8 +394,8 @@ static void print_scrobble_valid_check(const struct scrobble *s, enum log_levels
     if (NULL == s) {
         return;
     }
-    _log(log, "scrobble::valid::title[%s]: %s", s->title, strlen(s->title) > 0 ? "yes" : "no");
-    _log(log, "scrobble::valid::album[%s]: %s", s->album, strlen(s->album) > 0 ? "yes" : "no");
+    _log(log, "scrobble::valid::title[%s]: %s", scrobble_title(s), scrobble_has(s, scrobble_field_title) ? "yes" : "no");
+    _log(log, "scrobble::valid::album[%s]: %s", scrobble_album(s), scrobble_has(s, scrobble_field_album) ? "yes" : "no");
     _log(log, "scrobble::valid::length[%u]: %s", s->length, s->length > MIN_TRACK_LENGTH ? "yes" : "no");
     double scrobble_interval = min_scrobble_seconds(s);
     double d = 0;
@@ -343,21 +406,22 @@ static void print_scrobble_valid_check(const struct scrobble *s, enum log_levels
         d = difftime(now, s->start_time) + 1lu;
     }
     _log(log, "scrobble::valid::play_time[%.3lf:%.3lf]: %s", d, scrobble_interval, d >= scrobble_interval ? "yes" : "no");
-    if (!_is_zero(s->artist)) {
-        _log(log, "scrobble::valid::artist[%s]: %s", s->artist[0], strlen(s->artist[0]) > 0 ? "yes" : "no");
+    if (scrobble_has(s, scrobble_field_artist)) {
+        _log(log, "scrobble::valid::artist[%s]: %s", scrobble_artist(s, 0), "yes");
     }
     _log(log, "scrobble::valid::scrobbled: %s", !s->scrobbled ? "yes" : "no");
 }
 
 static bool scrobble_is_empty(const struct scrobble *s)
 {
-    return _is_zero(s);
+    if (NULL == s) { return true; }
+    return s->pool_length == 0 && s->length == 0 && s->start_time == 0 && s->play_time == 0 && s->position == 0;
 }
 
 static bool scrobble_is_valid(const struct scrobble *s)
 {
     if (NULL == s) { return false; }
-    if (_is_zero(s->artist)) { return false; }
+    if (!scrobble_has(s, scrobble_field_artist)) { return false; }
 
     double scrobble_interval = min_scrobble_seconds(s);
     double d;
@@ -372,9 +436,8 @@ static bool scrobble_is_valid(const struct scrobble *s)
         s->length >= MIN_TRACK_LENGTH &&
         d >= scrobble_interval &&
         s->scrobbled == false &&
-        strlen(s->title) > 0 &&
-        strlen(s->artist[0]) > 0 &&
-        strlen(s->album) > 0
+        scrobble_has(s, scrobble_field_title) &&
+        scrobble_has(s, scrobble_field_album)
     );
     return result;
 }
@@ -385,11 +448,10 @@ bool now_playing_is_valid(const struct scrobble *m/*, const time_t current_time,
     }
 
     //assert(m->position <= (double)m->length);
-    if (_is_zero(m->artist)) { return false; }
     bool result = (
-        strlen(m->title) > 0 &&
-        strlen(m->artist[0]) > 0 &&
-        strlen(m->album) > 0 &&
+        scrobble_has(m, scrobble_field_title) &&
+        scrobble_has(m, scrobble_field_artist) &&
+        scrobble_has(m, scrobble_field_album) &&
 //        last_playing_time > 0 &&
 //        difftime(current_time, last_playing_time) >= LASTFM_NOW_PLAYING_DELAY &&
         m->length > 0.0 &&
@@ -399,35 +461,29 @@ bool now_playing_is_valid(const struct scrobble *m/*, const time_t current_time,
     return result;
 }
 
-static void scrobble_copy (struct scrobble *t, const struct scrobble *s)
+struct scrobble *load_scrobble(const struct mpris_properties *p, const struct mpris_event *e)
 {
-    assert(NULL != t);
-    assert(NULL != s);
-    memcpy(t, s, sizeof(*t));
-}
-
-static bool scrobbles_equal(const struct scrobble *s, const struct scrobble *p)
-{
-    if ((NULL == s) && (NULL == p)) { return true; }
-
-    assert(NULL != s);
-    assert(NULL != p);
-
-    if (s == p) { return true; }
-
-    bool result = _eq(s, p);
-    _trace("scrobbler::check_scrobbles(%p:%p) %s", s, p, result ? "same" : "different");
-    return result;
-}
-
-bool load_scrobble(struct scrobble *d, const struct mpris_properties *p, const struct mpris_event *e)
-{
-    assert (NULL != d);
     assert (NULL != p);
 
-    memcpy(d->title, p->metadata.title, sizeof(p->metadata.title));
-    memcpy(d->album, p->metadata.album, sizeof(p->metadata.album));
-    memcpy(d->artist, p->metadata.artist, sizeof(p->metadata.artist));
+    struct scrobble_values values = {0};
+    values.values[scrobble_field_title][0] = p->metadata.title;
+    values.values[scrobble_field_album][0] = p->metadata.album;
+    for (int i = 0; i < MAX_PROPERTY_COUNT; i++) {
+        values.values[scrobble_field_artist][i] = p->metadata.artist[i];
+        // musicbrainz data
+        values.values[scrobble_field_mb_track_id][i] = p->metadata.mb_track_id[i];
+        values.values[scrobble_field_mb_album_id][i] = p->metadata.mb_album_id[i];
+        values.values[scrobble_field_mb_artist_id][i] = p->metadata.mb_artist_id[i];
+        values.values[scrobble_field_mb_album_artist_id][i] = p->metadata.mb_album_artist_id[i];
+    }
+    // if this is spotify we add the track_id as the spotify_id
+    int spotify_prefix_len = strlen(MPRIS_SPOTIFY_TRACK_ID_PREFIX);
+    if (NULL != p->metadata.track_id && strncmp(p->metadata.track_id, MPRIS_SPOTIFY_TRACK_ID_PREFIX, spotify_prefix_len) == 0){
+        values.values[scrobble_field_spotify_id][0] = p->metadata.track_id + spotify_prefix_len;
+    }
+
+    struct scrobble *d = scrobble_pack(&values);
+    if (NULL == d) { return NULL; }
 
     d->length = 0u;
     if (p->metadata.length > 0) {
@@ -438,25 +494,15 @@ bool load_scrobble(struct scrobble *d, const struct mpris_properties *p, const s
     }
     d->scrobbled = false;
     d->track_number = p->metadata.track_number;
-    if (mpris_event_changed_track(e) && mpris_properties_is_playing(p)) {
-        // we're checking if it's a newly started track, in order to set the start_time accordingly
+    d->fingerprint = p->metadata.fingerprint;
+    if ((mpris_event_changed_track(e) || mpris_event_changed_playback_status(e)) && mpris_properties_is_playing(p)) {
+        // we're checking if it's a newly started, or resumed, track in order to set the start_time accordingly
         d->start_time = e->timestamp;
     }
     if (d->position > 0) {
         d->play_time = d->position;
     }
-
-    // musicbrainz data
-    memcpy(d->mb_track_id, p->metadata.mb_track_id, sizeof(d->mb_track_id));
-    memcpy(d->mb_album_id, p->metadata.mb_album_id, sizeof(d->mb_album_id));
-    memcpy(d->mb_artist_id, p->metadata.mb_artist_id, sizeof(d->mb_artist_id));
-    memcpy(d->mb_album_artist_id, p->metadata.mb_album_artist_id, sizeof(d->mb_album_artist_id));
-    // if this is spotify we add the track_id as the spotify_id
-    int spotify_prefix_len = strlen(MPRIS_SPOTIFY_TRACK_ID_PREFIX);
-    if (strncmp(p->metadata.track_id, MPRIS_SPOTIFY_TRACK_ID_PREFIX, spotify_prefix_len) == 0){
-        memcpy(d->mb_spotify_id, p->metadata.track_id + spotify_prefix_len, sizeof(p->metadata.track_id)-spotify_prefix_len);
-    }
-    return true;
+    return d;
 }
 
 bool scrobbles_append(struct scrobbler *scrobbler, const struct scrobble *track)
@@ -464,12 +510,23 @@ bool scrobbles_append(struct scrobbler *scrobbler, const struct scrobble *track)
     assert(NULL != scrobbler);
     assert(NULL != track);
 
-    int queue_length = scrobbler->queue_length;
+    struct scrobble_queue *queue = &scrobbler->queue;
+    size_t queue_length = scrobble_queue_length(queue);
+
+    // a track resumed after a pause gets queued again, it's skipped if the first play didn't end yet
+    if (track->fingerprint != 0 && track->fingerprint == scrobbler->queued_fingerprint && track->start_time < scrobbler->queued_until) {
+        _debug("scrobbler::queue_skip[%016" PRIx64 "]: already queued %s//%s//%s", track->fingerprint, scrobble_title(track), scrobble_artist(track, 0), scrobble_album(track));
+        return false;
+    }
 
-    struct scrobble *top = &scrobbler->queue[queue_length];
-    scrobble_copy(top, track);
+    struct scrobble *top = scrobble_copy(track);
+    if (NULL == top) { return false; }
+    scrobble_queue_push(queue, top);
 
     top->play_time = difftime(time(0), top->start_time);
+    top->journal_id = journal_add(&scrobbler->journal, top);
+    scrobbler->queued_fingerprint = top->fingerprint;
+    scrobbler->queued_until = top->start_time + top->length;
 #if 0
     if (top->play_time == 0) {
         // TODO(marius): we need to be able to load the current playing mpris_properties from the track
@@ -478,67 +535,104 @@ bool scrobbles_append(struct scrobbler *scrobbler, const struct scrobble *track)
     _debug("scrobbler::queue:setting_top_scrobble_playtime(%.3f): %s//%s//%s", top->play_time, top->title, top->artist[0], top->album);
 #endif
 
-    scrobbler->queue_length++;
-
-    _trace("scrobbler::queue_push(%4zu) %s//%s//%s", queue_length, track->title, track->artist[0], track->album);
-    for (int pos = scrobbler->queue_length-2; pos >= 0; pos--) {
-        struct scrobble *current = &scrobbler->queue[pos];
+    _trace("scrobbler::queue_push(%4zu:%016" PRIx64 ") %s//%s//%s", queue_length, track->fingerprint, scrobble_title(track), scrobble_artist(track, 0), scrobble_album(track));
+    for (int pos = queue->length-2; pos >= 0; pos--) {
+        struct scrobble *current = scrobble_queue_at(queue, pos);
         if (scrobble_is_empty (current)) {
             continue;
         }
-        _debug("scrobbler::%5svalid(%4zu) %s//%s//%s", scrobble_is_valid(current) ? "" : "in", pos, current->title, current->artist[0], current->album);
+        _debug("scrobbler::%5svalid(%4zu) %s//%s//%s", scrobble_is_valid(current) ? "" : "in", pos, scrobble_title(current), scrobble_artist(current, 0), scrobble_album(current));
     }
-    _trace("scrobbler::new_queue_length: %zu", scrobbler->queue_length);
+    _trace("scrobbler::new_queue_length: %zu", scrobble_queue_length(queue));
 
     return true;
 }
 
+/*
+ * Submits the valid scrobbles out of the list, and discards the invalid ones
+ */
+static size_t scrobbles_submit(struct scrobbler *scrobbler, struct scrobble *scrobbles[], int count)
+{
+    size_t consumed = 0;
+    const struct scrobble *tracks[count];
+    for (int pos = count - 1; pos >= 0; pos--) {
+        struct scrobble *current = scrobbles[pos];
+        if (scrobble_is_valid(current)) {
+            tracks[consumed] = current;
+            current->scrobbled = true;
+            _info("scrobbler::scrobble:(%4zu) %s//%s//%s", pos, scrobble_title(current), scrobble_artist(current, 0), scrobble_album(current));
+            consumed++;
+        } else {
+            journal_discard(&scrobbler->journal, current->journal_id);
+        }
+    }
+    if (consumed > 0) {
+        api_request_do(scrobbler, tracks, consumed, api_build_request_scrobble);
+    }
+    return consumed;
+}
+
 size_t scrobbles_consume_queue(struct scrobbler *scrobbler)
 {
     assert (NULL != scrobbler);
 
-    int queue_length = scrobbler->queue_length;
-    _trace("scrobbler::queue_length: %u", queue_length);
+    struct scrobble_queue *queue = &scrobbler->queue;
+    _trace("scrobbler::queue_length: %zu", scrobble_queue_length(queue));
 
-    size_t consumed = 0;
-    int top = scrobbler->queue_length - 1;
+    int queue_length = queue->length;
     bool top_scrobble_invalid = false;
-
-    struct scrobble *tracks[queue_length];
-    for (int pos = top; pos >= 0; pos--) {
-        struct scrobble *current = &scrobbler->queue[pos];
-        bool valid = scrobble_is_valid(current);
-
-        if (valid) {
-            tracks[pos] = current;
-            current->scrobbled = true;
-            _info("scrobbler::scrobble:(%4zu) %s//%s//%s", pos, current->title, current->artist[0], current->album);
-            consumed++;
-        } else if (pos == top) {
-            _trace("scrobbler::scrobble::invalid:(%p//%4zu) %s//%s//%s", current, pos, current->title, current->artist[0], current->album);
+    if (queue_length > 0) {
+        int top = queue_length - 1;
+        struct scrobble *current = scrobble_queue_at(queue, top);
+        top_scrobble_invalid = !scrobble_is_valid(current);
+        if (top_scrobble_invalid) {
+            _trace("scrobbler::scrobble::invalid:(%p//%4zu) %s//%s//%s", current, top, scrobble_title(current), scrobble_artist(current, 0), scrobble_album(current));
             print_scrobble_valid_check(current, log_tracing);
-            top_scrobble_invalid = true;
-            // skip memory zeroing for top scrobble
-            continue;
+            // skip the top scrobble, it might still be playing
+            queue_length--;
         }
     }
-    if (consumed > 0) {
-        api_request_do(scrobbler, (const struct scrobble**)tracks, consumed, api_build_request_scrobble);
+
+    size_t consumed = 0;
+    bool in_memory_submitted = false;
+    if (queue->spill.length > 0) {
+        // the oldest scrobbles are paged out, we load them in chunks to keep the memory usage flat
+        struct scrobble *chunk[QUEUE_CONSUME_CHUNK] = {0};
+
+        size_t count = 0;
+        while ((count = scrobble_queue_read_spilled(queue, chunk, QUEUE_CONSUME_CHUNK)) > 0) {
+            size_t submit_count = count;
+            if (queue->spill.length == 0 && count + queue_length <= QUEUE_CONSUME_CHUNK) {
+                // the last chunk has room for the in memory scrobbles, which saves a request
+                for (int pos = 0; pos < queue_length; pos++) {
+                    chunk[submit_count] = scrobble_queue_at(queue, pos);
+                    submit_count++;
+                }
+                in_memory_submitted = true;
+            }
+            consumed += scrobbles_submit(scrobbler, chunk, submit_count);
+            for (size_t i = 0; i < count; i++) {
+                scrobble_free(chunk[i]);
+            }
+            memset(chunk, 0x0, sizeof(chunk));
+        }
     }
-    int min_scrobble_zero = 0;
-    if (top_scrobble_invalid) {
-        struct scrobble *first = &scrobbler->queue[0];
-        struct scrobble *last = &scrobbler->queue[top];
-        // leave the former top scrobble (which might still be playing) as the only one in the queue
-        memcpy(first, last, sizeof(*first));
-        memset(last, 0x0, sizeof(*last));
-        min_scrobble_zero = 1;
+
+    if (queue->length == 0) {
+        return consumed;
     }
-    for (int pos = top; pos >= min_scrobble_zero; pos--) {
-        memset(&scrobbler->queue[pos], 0x0, sizeof(scrobbler->queue[pos]));
-        scrobbler->queue_length--;
+
+    if (!in_memory_submitted && queue_length > 0) {
+        struct scrobble *tracks[queue_length];
+        for (int pos = 0; pos < queue_length; pos++) {
+            tracks[pos] = scrobble_queue_at(queue, pos);
+        }
+        consumed += scrobbles_submit(scrobbler, tracks, queue_length);
     }
 
+    // leave the former top scrobble (which might still be playing) as the only one in the queue
+    scrobble_queue_clear(queue, top_scrobble_invalid);
+
     return consumed;
 }
 
@@ -563,18 +657,18 @@ void state_loaded_properties(DBusConnection *conn, struct mpris_player *player,
     }
     debug_event(&player->changed);
 
-    struct scrobble scrobble = {0};
-    load_scrobble(&scrobble, properties, what_happened);
-
-    if (scrobble_is_empty(&scrobble)) {
-        _warn("events::invalid_scrobble");
-        return;
-    }
-
     if (mpris_player_is_playing(player)) {
+        // the scrobble is only built for the changes which need one, most signals are position updates
         if(mpris_event_changed_track(what_happened) || mpris_event_changed_playback_status(what_happened)) {
-            add_event_now_playing(player, &scrobble, 0);
-            add_event_queue(player, &scrobble);
+            struct scrobble *scrobble = load_scrobble(properties, what_happened);
+            if (scrobble_is_empty(scrobble)) {
+                _warn("events::invalid_scrobble");
+                scrobble_free(scrobble);
+                return;
+            }
+            add_event_now_playing(player, scrobble, 0);
+            add_event_queue(player, scrobble);
+            scrobble_free(scrobble);
         }
     } else {
         // remove add_now_event
@@ -606,17 +700,22 @@ void check_player(struct mpris_player* player)
     if (!mpris_player_is_valid(player) || !mpris_player_is_playing(player) || player->ignored) {
         return;
     }
-    const struct mpris_event all = {.loaded_state = mpris_load_all };
-    struct scrobble scrobble = {0};
+    const struct mpris_event all = {.loaded_state = mpris_load_all, .track_changed = true, };
 
-    load_scrobble(&scrobble, &player->properties, &all);
-    add_event_now_playing(player, &scrobble, 0);
-    add_event_queue(player, &scrobble);
+    struct scrobble *scrobble = load_scrobble(&player->properties, &all);
+    if (scrobble_is_empty(scrobble)) {
+        scrobble_free(scrobble);
+        return;
+    }
+    add_event_now_playing(player, scrobble, 0);
+    add_event_queue(player, scrobble);
+    scrobble_free(scrobble);
 }
 
 struct events *events_new(void);
 void events_init(struct events*, struct state*);
 void scrobbler_init(struct scrobbler*, struct configuration*, struct event_base*);
+void player_index_add(struct player_index*, struct mpris_player*);
 bool state_init(struct state *s, struct configuration *config)
 {
     _trace2("mem::initing_state(%p)", s);
@@ -632,12 +731,18 @@ bool state_init(struct state *s, struct configuration *config)
     if (NULL == s->events.base) { return false; }
     scrobbler_init(&s->scrobbler, s->config, s->events.base);
 
-    s->player_count = mpris_players_init(s->dbus, s->players, s->events, &s->scrobbler, s->config->ignore_players, s->config->ignore_players_count);
-    for (int i = 0; i < s->player_count; i++) {
-        struct mpris_player *player = &s->players[i];
-        check_player(player);
+    s->players = mpris_players_init(s->dbus, s->events, &s->scrobbler, s->config);
+    for (int i = 0; i < arrlen(s->players); i++) {
+        player_index_add(&s->player_names, s->players[i]);
+        check_player(s->players[i]);
+    }
+    _trace2("mem::loaded %td players", arrlen(s->players));
+
+    size_t queue_length = scrobble_queue_length(&s->scrobbler.queue);
+    if (queue_length > 0) {
+        _info("scrobbler::queue: resubmitting %zu scrobbles from the journal", queue_length);
+        scrobbles_consume_queue(&s->scrobbler);
     }
-    _trace2("mem::loaded %zd players", s->player_count);
 
     _trace2("mem::inited_state(%p)", s);
     return true;
@@ -0,0 +1,210 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+#ifndef MPRIS_SCROBBLER_SCROBBLE_RECORD_H
+#define MPRIS_SCROBBLER_SCROBBLE_RECORD_H
+
+#include <ctype.h>
+
+#define TRACK_FINGERPRINT_OFFSET    14695981039346656037ULL
+#define TRACK_FINGERPRINT_PRIME     1099511628211ULL
+
+#define scrobble_title(s)               scrobble_get(s, scrobble_field_title, 0)
+#define scrobble_album(s)               scrobble_get(s, scrobble_field_album, 0)
+#define scrobble_spotify_id(s)          scrobble_get(s, scrobble_field_spotify_id, 0)
+#define scrobble_artist(s, i)           scrobble_get(s, scrobble_field_artist, i)
+#define scrobble_mb_track_id(s, i)      scrobble_get(s, scrobble_field_mb_track_id, i)
+#define scrobble_mb_album_id(s, i)      scrobble_get(s, scrobble_field_mb_album_id, i)
+#define scrobble_mb_artist_id(s, i)     scrobble_get(s, scrobble_field_mb_artist_id, i)
+#define scrobble_mb_album_artist_id(s, i) scrobble_get(s, scrobble_field_mb_album_artist_id, i)
+
+/*
+ * The values a scrobble gets packed from, empty or NULL values are skipped
+ */
+struct scrobble_values {
+    const char *values[scrobble_field_count][MAX_PROPERTY_COUNT];
+};
+
+/*
+ * FNV-1a of the value ignoring case, and the leading, trailing and repeated white space,
+ * followed by a separator so the values can't run into each other
+ */
+static uint64_t track_fingerprint_string(uint64_t hash, const char *value)
+{
+    bool started = false;
+    bool space = false;
+    for (const unsigned char *c = (const unsigned char*)value; NULL != value && *c != '\0'; c++) {
+        if (isspace(*c)) {
+            space = started;
+            continue;
+        }
+        if (space) {
+            hash ^= ' ';
+            hash *= TRACK_FINGERPRINT_PRIME;
+            space = false;
+        }
+        hash ^= (unsigned char)tolower(*c);
+        hash *= TRACK_FINGERPRINT_PRIME;
+        started = true;
+    }
+    hash ^= 0xffU;
+    hash *= TRACK_FINGERPRINT_PRIME;
+    return hash;
+}
+
+static uint64_t track_fingerprint_number(uint64_t hash, uint64_t value)
+{
+    for (size_t i = 0; i < sizeof(value); i++) {
+        hash ^= (value >> (i * 8)) & 0xffU;
+        hash *= TRACK_FINGERPRINT_PRIME;
+    }
+    return hash;
+}
+
+/*
+ * Identifies a track by its normalized title, album, artists, length (in seconds) and track number,
+ * so comparing two tracks takes one integer compare. It's never 0, which is left for unknown tracks.
+ */
+uint64_t track_fingerprint(const char *title, const char *album, const char *const artist[MAX_PROPERTY_COUNT], unsigned length, unsigned track_number)
+{
+    uint64_t hash = TRACK_FINGERPRINT_OFFSET;
+    hash = track_fingerprint_string(hash, title);
+    hash = track_fingerprint_string(hash, album);
+    for (int i = 0; i < MAX_PROPERTY_COUNT && NULL != artist[i]; i++) {
+        hash = track_fingerprint_string(hash, artist[i]);
+    }
+    hash = track_fingerprint_number(hash, length);
+    hash = track_fingerprint_number(hash, track_number);
+    return hash != 0 ? hash : 1;
+}
+
+static inline size_t scrobble_size(const struct scrobble *s)
+{
+    return sizeof(struct scrobble) + s->pool_length;
+}
+
+static inline size_t scrobble_count(const struct scrobble *s, enum scrobble_field field)
+{
+    if (NULL == s) { return 0; }
+    return s->fields[field].count;
+}
+
+const char *scrobble_get(const struct scrobble *s, enum scrobble_field field, size_t idx)
+{
+    if (NULL == s || idx >= s->fields[field].count) { return ""; }
+
+    const char *value = s->pool + s->fields[field].offset;
+    for (size_t i = 0; i < idx; i++) {
+        value += strlen(value) + 1;
+    }
+    return value;
+}
+
+static inline bool scrobble_has(const struct scrobble *s, enum scrobble_field field)
+{
+    return scrobble_count(s, field) > 0;
+}
+
+struct scrobble *scrobble_pack(const struct scrobble_values *v)
+{
+    size_t pool_length = 0;
+    for (int f = 0; f < scrobble_field_count; f++) {
+        for (int i = 0; i < MAX_PROPERTY_COUNT; i++) {
+            const char *value = v->values[f][i];
+            if (NULL == value || value[0] == '\0') { continue; }
+            pool_length += strnlen(value, MAX_PROPERTY_LENGTH - 1) + 1;
+        }
+    }
+
+    struct scrobble *result = calloc(1, sizeof(struct scrobble) + pool_length);
+    if (NULL == result) { return NULL; }
+    result->pool_length = pool_length;
+
+    size_t offset = 0;
+    for (int f = 0; f < scrobble_field_count; f++) {
+        result->fields[f].offset = offset;
+        for (int i = 0; i < MAX_PROPERTY_COUNT; i++) {
+            const char *value = v->values[f][i];
+            if (NULL == value || value[0] == '\0') { continue; }
+            size_t len = strnlen(value, MAX_PROPERTY_LENGTH - 1);
+            memcpy(result->pool + offset, value, len);
+            offset += len + 1;
+            result->fields[f].count++;
+        }
+    }
+    return result;
+}
+
+/*
+ * Loads a scrobble from its bytes, as written to the journal or the queue segment file,
+ * checking that the offset table points inside the pool.
+ */
+struct scrobble *scrobble_load(const char *data, size_t length)
+{
+    if (NULL == data || length < sizeof(struct scrobble)) { return NULL; }
+
+    struct scrobble header;
+    memcpy(&header, data, sizeof(header));
+    if (length != sizeof(struct scrobble) + header.pool_length) { return NULL; }
+
+    const char *pool = data + sizeof(struct scrobble);
+    if (header.pool_length > 0 && pool[header.pool_length - 1] != '\0') { return NULL; }
+    for (int f = 0; f < scrobble_field_count; f++) {
+        size_t offset = header.fields[f].offset;
+        for (int i = 0; i < header.fields[f].count; i++) {
+            if (offset >= header.pool_length) { return NULL; }
+            offset += strlen(pool + offset) + 1;
+        }
+    }
+
+    struct scrobble *result = malloc(length);
+    if (NULL == result) { return NULL; }
+    memcpy(result, data, length);
+    return result;
+}
+
+struct scrobble *scrobble_copy(const struct scrobble *s)
+{
+    if (NULL == s) { return NULL; }
+
+    size_t size = scrobble_size(s);
+    struct scrobble *result = malloc(size);
+    if (NULL == result) { return NULL; }
+    memcpy(result, s, size);
+    return result;
+}
+
+void scrobble_free(struct scrobble *s)
+{
+    if (NULL == s) { return; }
+    free(s);
+}
+
+void scrobble_field_log(char *output, const struct scrobble *s, enum scrobble_field field)
+{
+    memset(output, 0, MAX_PROPERTY_LENGTH*MAX_PROPERTY_COUNT+9);
+
+    size_t count = scrobble_count(s, field);
+    if (count == 0) { return; }
+
+    char temp[MAX_PROPERTY_COUNT*MAX_PROPERTY_LENGTH+1] = {0};
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++) {
+        const char *value = scrobble_get(s, field, i);
+        size_t value_len = strlen(value);
+        if (len + value_len + 2 >= sizeof(temp)) { break; }
+        if (i > 0) {
+            memcpy(temp + len, ", ", 2);
+            len += 2;
+        }
+        memcpy(temp + len, value, value_len);
+        len += value_len;
+    }
+    if (count > 1) {
+        snprintf(output, MAX_PROPERTY_LENGTH*MAX_PROPERTY_COUNT+9, "[%u]: %s", (uint8_t)count, temp);
+    } else {
+        snprintf(output, MAX_PROPERTY_LENGTH*MAX_PROPERTY_COUNT+1, "%s", temp);
+    }
+}
+
+#endif // MPRIS_SCROBBLER_SCROBBLE_RECORD_H
@@ -6,8 +6,49 @@
 
 #include <assert.h>
 #include <curl/curl.h>
+#include "journal.h"
+#include "queue.h"
+#include "retry.h"
+#include "ratelimit.h"
 #include "curl.h"
 
+/*
+ * Takes an easy handle for the service, an idle one if there is any, which keeps the options
+ * set when it was created, or a new one
+ */
+static CURL *scrobbler_easy_handle_get(struct scrobbler *s, enum api_type end_point)
+{
+    if (arrlen(s->idle_handles[end_point]) > 0) {
+        return arrpop(s->idle_handles[end_point]);
+    }
+    CURL *handle = curl_easy_init();
+    build_curl_handle(handle, s);
+    _trace2("scrobbler::easy_handle_new[%s]: %p", get_api_type_label(end_point), handle);
+    return handle;
+}
+
+/* Keeps the easy handle of a finished request for the next one, if there's room */
+static void scrobbler_easy_handle_put(struct scrobbler *s, enum api_type end_point, CURL *handle)
+{
+    if (arrlen(s->idle_handles[end_point]) >= MAX_IDLE_HANDLES) {
+        curl_easy_cleanup(handle);
+        return;
+    }
+    clear_curl_request(handle);
+    arrput(s->idle_handles[end_point], handle);
+}
+
+static void scrobbler_easy_handles_clean(struct scrobbler *s)
+{
+    for (int i = 0; i < API_TYPE_COUNT; i++) {
+        for (int j = 0; j < arrlen(s->idle_handles[i]); j++) {
+            curl_easy_cleanup(s->idle_handles[i][j]);
+        }
+        arrfree(s->idle_handles[i]);
+        s->idle_handles[i] = NULL;
+    }
+}
+
 void scrobbler_connection_free (struct scrobbler_connection *conn)
 {
     if (NULL == conn) { return; }
@@ -27,14 +68,6 @@ void scrobbler_connection_free (struct scrobbler_connection *conn)
         conn->headers = NULL;
     }
 
-    if (event_initialized(&conn->ev)) {
-        _trace2("scrobbler::connection_free::event[%p]", &conn->ev);
-        event_del(&conn->ev);
-    }
-    if (event_initialized(&conn->retry_event)) {
-        _trace2("scrobbler::connection_free::retry_event[%p]", &conn->retry_event);
-        event_del(&conn->retry_event);
-    }
 
     if (NULL != conn->request) {
         _trace2("scrobbler::connection_free::request[%p]", conn->request);
@@ -46,12 +79,18 @@ void scrobbler_connection_free (struct scrobbler_connection *conn)
         http_response_free(conn->response);
         conn->response = NULL;
     }
+    if (NULL != conn->journal_ids) {
+        arrfree(conn->journal_ids);
+        conn->journal_ids = NULL;
+    }
     if (NULL != conn->handle) {
         _trace2("scrobbler::connection_free:curl_easy_handle[%p]", conn->handle);
-        if (NULL != conn->parent && NULL != conn->parent->handle && NULL != conn->handle) {
+        if (NULL != conn->parent && NULL != conn->parent->handle) {
             curl_multi_remove_handle(conn->parent->handle, conn->handle);
+            scrobbler_easy_handle_put(conn->parent, conn->credentials.end_point, conn->handle);
+        } else {
+            curl_easy_cleanup(conn->handle);
         }
-        curl_easy_cleanup(conn->handle);
         conn->handle = NULL;
     }
     _trace2("scrobbler::connection_free:conn[%p]", conn);
@@ -67,12 +106,16 @@ struct scrobbler_connection *scrobbler_connection_new(void)
 }
 
 static void event_cb(int, short, void *);
-void scrobbler_connection_init(struct scrobbler_connection *connection, struct scrobbler *s, struct api_credentials credentials, int idx)
+void scrobbler_connection_init(struct scrobbler_connection *connection, struct scrobbler *s, struct api_credentials credentials)
 {
-    connection->handle = curl_easy_init();
+    if (NULL != s) {
+        connection->handle = scrobbler_easy_handle_get(s, credentials.end_point);
+    } else {
+        connection->handle = curl_easy_init();
+        build_curl_handle(connection->handle, NULL);
+    }
     connection->response = http_response_new();
     memcpy(&connection->credentials, &credentials, sizeof(credentials));
-    connection->idx = idx;
     connection->parent = s;
     memset(&connection->error, '\0', CURL_ERROR_SIZE);
     _trace("scrobbler::connection_init[%s][%p]:curl_easy_handle(%p)", get_api_type_label(credentials.end_point), connection, connection->handle);
@@ -81,42 +124,80 @@ void scrobbler_connection_init(struct scrobbler_connection *connection, struct s
 
 static void scrobbler_connections_clean(struct scrobbler *s)
 {
-    if (s->connections_length == 0) { return; }
+    if (NULL == s->connection_slots) { return; }
 
-    for (int i = s->connections_length - 1; i >= 0; i--) {
-        struct scrobbler_connection *conn = s->connections[i];
+    int slots_count = arrlen(s->connection_slots);
+    for (int i = 0; i < slots_count; i++) {
+        struct scrobbler_connection *conn = s->connection_slots[i].conn;
         if (NULL == conn) {
             continue;
         }
 
         scrobbler_connection_free(conn);
-        s->connections[i] = NULL;
+        s->connection_slots[i].conn = NULL;
         s->connections_length--;
     }
+    arrfree(s->connection_slots);
+    s->connection_slots = NULL;
+    s->free_slot = -1;
     _trace2("scrobbler::connection_clean: new len %zd", s->connections_length);
 }
 
+/*
+ * Puts the connection in a free slot, or a new one if there are none
+ */
+static void scrobbler_connection_add(struct scrobbler *s, struct scrobbler_connection *conn)
+{
+    int idx = s->free_slot;
+    if (idx >= 0) {
+        s->free_slot = s->connection_slots[idx].next_free;
+    } else {
+        struct scrobbler_connection_slot slot = { .conn = NULL, .generation = 0, .next_free = -1, };
+        arrput(s->connection_slots, slot);
+        idx = arrlen(s->connection_slots) - 1;
+    }
+    s->connection_slots[idx].conn = conn;
+    s->connection_slots[idx].next_free = -1;
+    conn->idx = idx;
+    conn->generation = s->connection_slots[idx].generation;
+    s->connections_length++;
+    _trace2("scrobbler::connection_add: %zd, generation %" PRIu32 ": %p", idx, conn->generation, conn);
+}
+
+uint64_t scrobbler_connection_handle(const struct scrobbler_connection *conn)
+{
+    return ((uint64_t)conn->generation << 32) | (uint32_t)conn->idx;
+}
+
+/*
+ * Returns the connection for the handle, or NULL if it was freed in the meantime
+ */
+struct scrobbler_connection *scrobbler_connection_lookup(const struct scrobbler *s, uint64_t handle)
+{
+    int idx = (int)(handle & 0xffffffffU);
+    uint32_t generation = (uint32_t)(handle >> 32);
+    if (idx < 0 || idx >= arrlen(s->connection_slots)) { return NULL; }
+
+    const struct scrobbler_connection_slot *slot = &s->connection_slots[idx];
+    if (slot->generation != generation) { return NULL; }
+    return slot->conn;
+}
+
 static void scrobbler_connection_del(struct scrobbler *s, int idx)
 {
     assert(idx != -1);
-    if (NULL == s->connections[idx]) {
+    struct scrobbler_connection_slot *slot = &s->connection_slots[idx];
+    if (NULL == slot->conn) {
         return;
     }
 
-    _trace2("scrobbler::connection_del: remove %zd out of %zd: %p", idx, s->connections_length, s->connections[idx]);
-    struct scrobbler_connection *conn = s->connections[idx];
+    _trace2("scrobbler::connection_del: remove %zd out of %zd: %p", idx, s->connections_length, slot->conn);
+    scrobbler_connection_free(slot->conn);
 
-    scrobbler_connection_free(conn);
-
-    for (int i = idx + 1; i < s->connections_length; i++) {
-        struct scrobbler_connection *to_move = s->connections[i];
-        if (NULL == to_move) {
-            continue;
-        }
-        to_move->idx = i-1;
-        _trace2("scrobbler::connection_del: move %zd to %zd: %p", i, to_move->idx, to_move);
-        s->connections[i-1] = to_move;
-    }
+    slot->conn = NULL;
+    slot->generation++;
+    slot->next_free = s->free_slot;
+    s->free_slot = idx;
     s->connections_length--;
     _trace2("scrobbler::connection_del: new len %zd", s->connections_length);
 }
@@ -127,33 +208,47 @@ static void scrobbler_clean(struct scrobbler *s)
 
     _trace("scrobbler::clean[%p]", s);
 
+    for (int i = 0; i < API_TYPE_COUNT; i++) {
+        retry_clean(&s->retries[i]);
+        bucket_clean(&s->buckets[i]);
+    }
     scrobbler_connections_clean(s);
-    memset(s->connections, 0x0, sizeof(s->connections));
+    scrobbler_easy_handles_clean(s);
 
     if(evtimer_initialized(&s->timer_event) && evtimer_pending(&s->timer_event, NULL)) {
         _trace2("curl::multi_timer_remove(%p)", &s->timer_event);
         evtimer_del(&s->timer_event);
     }
+    if (NULL != s->handle) {
+        curl_multi_cleanup(s->handle);
+        s->handle = NULL;
+    }
+    // the share can only go away after all the easy handles using it
+    if (NULL != s->share) {
+        curl_share_cleanup(s->share);
+        s->share = NULL;
+    }
+
+    journal_close(&s->journal);
+    scrobble_queue_free(&s->queue);
 }
 
-static struct scrobbler_connection *scrobbler_connection_get(struct scrobbler *s, CURL *e)
+static unsigned scrobbler_services_mask(struct scrobbler *s)
 {
-    struct scrobbler_connection *conn = NULL;
-    for (int i = s->connections_length - 1; i >= 0; i--) {
-        conn = s->connections[i];
-        if (NULL == conn) {
-            _warn("curl::invalid_connection_handle:idx[%d] total[%d]", i, s->connections_length);
+    unsigned mask = 0;
+    int credentials_count = arrlen(s->credentials);
+    for (int i = 0; i < credentials_count; i++) {
+        struct api_credentials *cur = s->credentials[i];
+        if (!credentials_valid(cur)) {
             continue;
         }
-        if (conn->handle == e) {
-            _trace2("curl::found_easy_handle:idx[%d]: %p e[%p]", i, conn, conn->handle);
-            break;
-        }
-        //_trace2("curl::searching_easy_handle:idx[%d] e[%p:%p]", i, conn, e, conn->handle);
+        mask |= 1U << cur->end_point;
     }
-    return conn;
+    return mask;
 }
 
+char *get_journal_file(struct configuration*);
+char *get_queue_file(struct configuration*);
 void scrobbler_init(struct scrobbler *s, struct configuration *config, struct event_base *evbase)
 {
     s->credentials = config->credentials;
@@ -167,22 +262,102 @@ void scrobbler_init(struct scrobbler *s, struct configuration *config, struct ev
 
     long max_conn_count = 2.0 * arrlen(s->credentials);
     curl_multi_setopt(s->handle, CURLMOPT_MAX_TOTAL_CONNECTIONS, max_conn_count);
+    // with HTTP/2 the concurrent requests to a service are streams over the same connection
+    s->http2 = config->http2;
+    curl_multi_setopt(s->handle, CURLMOPT_PIPELINING, s->http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+    // keep one idle connection for each service in the cache
+    curl_multi_setopt(s->handle, CURLMOPT_MAXCONNECTS, (long)arrlen(s->credentials));
+
+    // share the DNS, TLS session and connection caches between all requests
+    s->share = curl_share_init();
+    if (NULL != s->share) {
+        curl_share_setopt(s->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(s->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+        curl_share_setopt(s->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    }
 
     s->evbase = evbase;
 
     evtimer_assign(&s->timer_event, s->evbase, timer_cb, s);
+    s->rate_limit = config->rate_limit;
+    s->rate_burst = config->rate_burst;
+    for (int i = 0; i < API_TYPE_COUNT; i++) {
+        retry_init(&s->retries[i], s, (enum api_type)i);
+        bucket_init(&s->buckets[i], s, (enum api_type)i);
+        s->now_playing[i] = UINT64_MAX; // doesn't resolve to any connection
+    }
     _trace2("curl::multi_timer_add(%p:%p)", s->handle, &s->timer_event);
     s->connections_length = 0;
+    s->free_slot = -1;
+
+    char *queue_path = get_queue_file(config);
+    scrobble_queue_init(&s->queue, queue_path);
+    if (NULL != queue_path) { string_free(queue_path); }
+
+    // load the scrobbles which didn't reach all the services before the last shutdown
+    char *journal_path = get_journal_file(config);
+    s->journal.required_services = scrobbler_services_mask(s);
+    journal_open(&s->journal, journal_path, evbase, &s->queue);
+    if (NULL != journal_path) { string_free(journal_path); }
 }
 
 typedef struct http_request*(*request_builder_t)(const struct scrobble*[], const int, const struct api_credentials*, CURL*);
 
+/*
+ * Only the latest now playing request for a service matters, so it cancels the previous one,
+ * whether that is in flight or still waiting for the rate limit or for the service to come back.
+ */
+static void scrobbler_supersede_now_playing(struct scrobbler *s, struct scrobbler_connection *conn)
+{
+    enum api_type end_point = conn->credentials.end_point;
+    struct scrobbler_connection *previous = scrobbler_connection_lookup(s, s->now_playing[end_point]);
+    s->now_playing[end_point] = scrobbler_connection_handle(conn);
+    if (NULL == previous || previous == conn || !previous->now_playing) { return; }
+
+    _debug("scrobbler::superseded[%s]: now playing %p, retried %d times", get_api_type_label(end_point), previous, previous->retries);
+    // the waiting lists skip the connection once it's removed
+    scrobbler_connection_del(s, previous->idx);
+}
+
+static void api_request_add(struct scrobbler *s, struct api_credentials *credentials, const struct scrobble *tracks[], const int track_count, request_builder_t build_request)
+{
+    struct scrobbler_connection *conn = scrobbler_connection_new();
+    scrobbler_connection_init(conn, s, *credentials);
+    conn->request = build_request(tracks, track_count, credentials, conn->handle);
+    conn->now_playing = build_request == api_build_request_now_playing;
+    for (int j = 0; j < track_count; j++) {
+        if (tracks[j]->journal_id == 0) {
+            continue;
+        }
+        arrput(conn->journal_ids, tracks[j]->journal_id);
+    }
+    scrobbler_connection_add(s, conn);
+    if (conn->now_playing) {
+        scrobbler_supersede_now_playing(s, conn);
+    }
+
+    build_curl_request(conn);
+
+    // while the service is unavailable the request waits with the failed ones
+    if (retry_hold(&s->retries[credentials->end_point], conn)) {
+        return;
+    }
+    // over the rate limit the request waits for its turn
+    if (bucket_hold(&s->buckets[credentials->end_point], conn)) {
+        return;
+    }
+    curl_multi_add_handle(s->handle, conn->handle);
+}
+
 void api_request_do(struct scrobbler *s, const struct scrobble *tracks[], const int track_count, request_builder_t build_request)
 {
     if (NULL == s) { return; }
     if (NULL == s->credentials) { return; }
 
     int credentials_count = arrlen(s->credentials);
+    s->journal.required_services = scrobbler_services_mask(s);
 
     for (int i = 0; i < credentials_count; i++) {
         struct api_credentials *cur = s->credentials[i];
@@ -191,16 +366,93 @@ void api_request_do(struct scrobbler *s, const struct scrobble *tracks[], const
             continue;
         }
 
-        struct scrobbler_connection *conn = scrobbler_connection_new();
-        scrobbler_connection_init(conn, s, *cur, s->connections_length);
-        conn->request = build_request(tracks, track_count, cur, conn->handle);
-        s->connections[conn->idx] = conn;
-        s->connections_length++;
+        if (!retry_allows_request(&s->retries[cur->end_point], build_request == api_build_request_now_playing)) {
+            _debug("scrobbler::skipped[%s]: service unavailable", get_api_type_label(cur->end_point));
+            continue;
+        }
 
-        build_curl_request(conn);
+        // skip the tracks which this service already accepted before a restart
+        unsigned service = 1U << cur->end_point;
+        const struct scrobble *service_tracks[track_count];
+        int service_track_count = 0;
+        for (int j = 0; j < track_count; j++) {
+            if (tracks[j]->journal_services & service) {
+                continue;
+            }
+            service_tracks[service_track_count] = tracks[j];
+            service_track_count++;
+        }
+        if (service_track_count == 0) {
+            continue;
+        }
+
+        // split the tracks in batches the service accepts, each one gets its own connection
+        // so a failed batch gets retried by itself
+        int batch_size = api_get_max_batch_size(cur->end_point);
+        for (int start = 0; start < service_track_count; start += batch_size) {
+            int batch_count = min(batch_size, service_track_count - start);
+            _trace("scrobbler::batch[%s]: %d tracks out of %d", get_api_type_label(cur->end_point), batch_count, service_track_count);
+            api_request_add(s, cur, service_tracks + start, batch_count, build_request);
+        }
+    }
+}
+
+static bool scrobble_is_valid(const struct scrobble*);
+static int journal_id_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Sends the scrobbles which the service missed while it was unavailable, from the journal.
+ * The ones still in flight, or waiting, for the service are skipped, and so are the ones still
+ * in the queue, which get sent from there.
+ */
+void scrobbler_replay_backlog(struct scrobbler *s, enum api_type end_point)
+{
+    uint64_t *skipped = NULL;
+    for (int i = 0; i < arrlen(s->connection_slots); i++) {
+        struct scrobbler_connection *conn = s->connection_slots[i].conn;
+        if (NULL == conn || conn->credentials.end_point != end_point) { continue; }
+        for (int k = 0; k < arrlen(conn->journal_ids); k++) {
+            arrput(skipped, conn->journal_ids[k]);
+        }
+    }
+    scrobble_queue_journal_ids(&s->queue, &skipped);
+    if (arrlen(skipped) > 1) {
+        qsort(skipped, arrlen(skipped), sizeof(uint64_t), journal_id_cmp);
+    }
+
+    struct scrobble **backlog = journal_load_pending(&s->journal, 1U << end_point, skipped, arrlen(skipped));
+    int backlog_count = arrlen(backlog);
+    // the queue discards the invalid scrobbles it holds, these ones are in no queue anymore
+    int valid_count = 0;
+    for (int i = 0; i < backlog_count; i++) {
+        struct scrobble *track = backlog[i];
+        if (!scrobble_is_valid(track)) {
+            _debug("scrobbler::replay:invalid[%" PRIu64 "] %s//%s//%s", track->journal_id, scrobble_title(track), scrobble_artist(track, 0), scrobble_album(track));
+            journal_discard(&s->journal, track->journal_id);
+            scrobble_free(track);
+            continue;
+        }
+        backlog[valid_count] = track;
+        valid_count++;
+    }
+    if (valid_count > 0) {
+        _info("scrobbler::replay[%s]: %d scrobbles", get_api_type_label(end_point), valid_count);
+        for (int start = 0; start < valid_count; start += QUEUE_CONSUME_CHUNK) {
+            int count = min(QUEUE_CONSUME_CHUNK, valid_count - start);
+            api_request_do(s, (const struct scrobble**)backlog + start, count, api_build_request_scrobble);
+        }
+    }
 
-        curl_multi_add_handle(s->handle, conn->handle);
+    for (int i = 0; i < valid_count; i++) {
+        scrobble_free(backlog[i]);
     }
+    arrfree(backlog);
+    arrfree(skipped);
 }
 
 #endif // MPRIS_SCROBBLER_SCROBBLER_H
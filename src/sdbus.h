@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <unistd.h>
+#include "player_index.h"
 
 #ifdef DEBUG
 #define LOCAL_NAME                 "org.mpris.scrobbler-debug"
@@ -48,6 +49,7 @@
 #define DBUS_METHOD_GET            "Get"
 #define DBUS_METHOD_GET_ID         "GetId"
 #define DBUS_METHOD_PING           "Ping"
+#define DBUS_METHOD_GET_NAME_OWNER "GetNameOwner"
 
 #define MPRIS_METADATA_BITRATE      "bitrate"
 #define MPRIS_METADATA_ART_URL      "mpris:artUrl"
@@ -71,6 +73,10 @@
 #define DBUS_SIGNAL_PROPERTIES_CHANGED   "PropertiesChanged"
 #define DBUS_SIGNAL_NAME_OWNER_CHANGED   "NameOwnerChanged"
 
+#define DBUS_MATCH_PROPERTIES_CHANGED    "type='signal',interface='" DBUS_INTERFACE_PROPERTIES "',member='" DBUS_SIGNAL_PROPERTIES_CHANGED "',path='" MPRIS_PLAYER_PATH "'"
+// only the names in the MPRIS namespace, the bus is full of short lived clients
+#define DBUS_MATCH_NAME_OWNER_CHANGED    "type='signal',interface='" DBUS_INTERFACE_DBUS "',member='" DBUS_SIGNAL_NAME_OWNER_CHANGED "',path='" DBUS_PATH_DBUS "',arg0namespace='" MPRIS_PLAYER_NAMESPACE "'"
+
 // The default timeout leads to hangs when calling
 //   certain players which don't seem to reply to MPRIS methods
 #define DBUS_CONNECTION_TIMEOUT    100 //ms
@@ -118,6 +124,32 @@ static DBusMessage *call_dbus_method(DBusConnection *conn, char *destination, ch
     return reply;
 }
 
+/*
+ * Sends the message without waiting for the reply, notify is called with data once it arrives,
+ * or the call times out
+ */
+static DBusPendingCall *send_dbus_message_async(DBusConnection *conn, DBusMessage *msg, DBusPendingCallNotifyFunction notify, void *data)
+{
+    if (NULL == conn) { return NULL; }
+    if (NULL == msg) { return NULL; }
+
+    DBusPendingCall *pending = NULL;
+    if (!dbus_connection_send_with_reply (conn, msg, &pending, DBUS_CONNECTION_TIMEOUT)) {
+        return NULL;
+    }
+    if (NULL == pending) {
+        return NULL;
+    }
+    if (!dbus_pending_call_set_notify(pending, notify, data, NULL)) {
+        dbus_pending_call_cancel(pending);
+        dbus_pending_call_unref(pending);
+        return NULL;
+    }
+    dbus_connection_flush(conn);
+
+    return pending;
+}
+
 static void extract_double_var(DBusMessageIter *iter, double *result, DBusError *error)
 {
     if (DBUS_TYPE_VARIANT != dbus_message_iter_get_arg_type(iter)) {
@@ -136,7 +168,10 @@ static void extract_double_var(DBusMessageIter *iter, double *result, DBusError
     return;
 }
 
-static int extract_string_array_var(DBusMessageIter *iter, char result[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH], DBusError *err)
+/*
+ * The extracted strings are borrowed from the message, and are valid only as long as it is
+ */
+static int extract_string_array_var(DBusMessageIter *iter, const char *result[MAX_PROPERTY_COUNT], DBusError *err)
 {
     if (DBUS_TYPE_VARIANT != dbus_message_iter_get_arg_type(iter)) {
         dbus_set_error_const(err, "iter_should_be_variant", "This message iterator must variant type");
@@ -165,20 +200,19 @@ static int extract_string_array_var(DBusMessageIter *iter, char result[MAX_PROPE
 
         if (l == 0 || l >= MAX_PROPERTY_LENGTH) { break; }
 
-        memcpy(result[read_count], temp.str, l);
+        result[read_count] = temp.str;
 #ifdef LIBDBUS_DEBUG
         _trace2("  dbus::loaded_array_of_strings[%4zd//%zd//%p]: %s", l, read_count, result[read_count], result[read_count]);
 #endif
         read_count++;
-        if (!dbus_message_iter_has_next(&arrayIter)) {
+        if (!dbus_message_iter_next(&arrayIter)) {
             break;
         }
-        dbus_message_iter_next(&arrayIter);
     }
     return read_count;
 }
 
-static void extract_string_var(DBusMessageIter *iter, char *result, DBusError *error)
+static void extract_string_var(DBusMessageIter *iter, const char **result, DBusError *error)
 {
     if (DBUS_TYPE_VARIANT != dbus_message_iter_get_arg_type(iter)) {
         dbus_set_error_const(error, "iter_should_be_variant", "This message iterator must have variant type");
@@ -196,14 +230,25 @@ static void extract_string_var(DBusMessageIter *iter, char *result, DBusError *e
         int l = strlen(temp.str);
 
         if (l > 0 && l < MAX_PROPERTY_LENGTH) {
-            memcpy(result, temp.str, l);
+            *result = temp.str;
 #ifdef LIBDBUS_DEBUG
-            _trace2("  dbus::loaded_basic_string[%zd//%p]: %s", l, result, result);
+            _trace2("  dbus::loaded_basic_string[%zd//%p]: %s", l, *result, *result);
 #endif
         }
     }
 }
 
+static void extract_status_var(DBusMessageIter *iter, char result[MPRIS_STATUS_LENGTH], DBusError *error)
+{
+    const char *value = NULL;
+    extract_string_var(iter, &value, error);
+    if (NULL == value) { return; }
+
+    size_t len = strnlen(value, MPRIS_STATUS_LENGTH - 1);
+    memcpy(result, value, len);
+    result[len] = '\0';
+}
+
 static void extract_int32_var(DBusMessageIter *iter, int32_t *result, DBusError *error)
 {
     if (DBUS_TYPE_VARIANT != dbus_message_iter_get_arg_type(iter)) {
@@ -298,27 +343,26 @@ static void load_metadata(DBusMessageIter *iter, struct mpris_metadata *track, s
             }
             dbus_message_iter_get_basic(&dictIter, &key);
 
-            if (!dbus_message_iter_has_next(&dictIter)) {
-                continue;
+            if (!dbus_message_iter_next(&dictIter)) {
+                break;
             }
-            dbus_message_iter_next(&dictIter);
             if (!strncmp(key, MPRIS_METADATA_BITRATE, strlen(MPRIS_METADATA_BITRATE))) {
                 extract_int32_var(&dictIter, (int32_t*)&track->bitrate, &err);
                 changes->loaded_state |= mpris_load_metadata_bitrate;
             } else if (!strncmp(key, MPRIS_METADATA_ART_URL, strlen(MPRIS_METADATA_ART_URL))) {
-                extract_string_var(&dictIter, track->art_url, &err);
+                extract_string_var(&dictIter, &track->art_url, &err);
                 changes->loaded_state |= mpris_load_metadata_art_url;
             } else if (!strncmp(key, MPRIS_METADATA_LENGTH, strlen(MPRIS_METADATA_LENGTH))) {
                 extract_int64_var(&dictIter, (int64_t*)&track->length, &err);
                 changes->loaded_state |= mpris_load_metadata_length;
             } else if (!strncmp(key, MPRIS_METADATA_TRACKID, strlen(MPRIS_METADATA_TRACKID))) {
-                extract_string_var(&dictIter, track->track_id, &err);
+                extract_string_var(&dictIter, &track->track_id, &err);
                 changes->loaded_state |= mpris_load_metadata_track_id;
             } else if (!strncmp(key, MPRIS_METADATA_ALBUM_ARTIST, strlen(MPRIS_METADATA_ALBUM_ARTIST))) {
                 extract_string_array_var(&dictIter, track->album_artist, &err);
                 changes->loaded_state |= mpris_load_metadata_album_artist;
             } else if (!strncmp(key, MPRIS_METADATA_ALBUM, strlen(MPRIS_METADATA_ALBUM)) && strncmp(key, MPRIS_METADATA_ALBUM_ARTIST, strlen(MPRIS_METADATA_ALBUM_ARTIST)) ) {
-                extract_string_var(&dictIter, track->album, &err);
+                extract_string_var(&dictIter, &track->album, &err);
                 changes->loaded_state |= mpris_load_metadata_album;
             } else if (!strncmp(key, MPRIS_METADATA_ARTIST, strlen(MPRIS_METADATA_ARTIST))) {
                 extract_string_array_var(&dictIter, track->artist, &err);
@@ -327,13 +371,13 @@ static void load_metadata(DBusMessageIter *iter, struct mpris_metadata *track, s
                 extract_string_array_var(&dictIter, track->comment, &err);
                 changes->loaded_state |= mpris_load_metadata_comment;
             } else if (!strncmp(key, MPRIS_METADATA_TITLE, strlen(MPRIS_METADATA_TITLE))) {
-                extract_string_var(&dictIter, track->title, &err);
+                extract_string_var(&dictIter, &track->title, &err);
                 changes->loaded_state |= mpris_load_metadata_title;
             } else if (!strncmp(key, MPRIS_METADATA_TRACK_NUMBER, strlen(MPRIS_METADATA_TRACK_NUMBER))) {
                 extract_int32_var(&dictIter, (int32_t*)&track->track_number, &err);
                 changes->loaded_state |= mpris_load_metadata_track_number;
             } else if (!strncmp(key, MPRIS_METADATA_URL, strlen(MPRIS_METADATA_URL))) {
-                extract_string_var(&dictIter, track->url, &err);
+                extract_string_var(&dictIter, &track->url, &err);
                 changes->loaded_state |= mpris_load_metadata_url;
             } else if (!strncmp(key, MPRIS_METADATA_GENRE, strlen(MPRIS_METADATA_GENRE))) {
                 extract_string_array_var(&dictIter, track->genre, &err);
@@ -350,19 +394,17 @@ static void load_metadata(DBusMessageIter *iter, struct mpris_metadata *track, s
                 changes->loaded_state |= mpris_load_metadata_mb_artist_id;
             } else if (!strncmp(key, MPRIS_METADATA_MUSICBRAINZ_ALBUMARTIST_ID, strlen(MPRIS_METADATA_MUSICBRAINZ_ALBUMARTIST_ID))) {
                 extract_string_array_var(&dictIter, track->mb_album_artist_id, &err);
-                changes->loaded_state |= mpris_load_metadata_mb_artist_id;
+                changes->loaded_state |= mpris_load_metadata_mb_album_artist_id;
             }
-            changes->track_changed = true;
             if (dbus_error_is_set(&err)) {
                 _error("dbus::value_error: %s, %s", key, err.message);
                 dbus_error_free(&err);
             }
         }
 
-        if (!dbus_message_iter_has_next(&arrayIter)) {
+        if (!dbus_message_iter_next(&arrayIter)) {
             break;
         }
-        dbus_message_iter_next(&arrayIter);
     }
     if (
         changes->loaded_state & mpris_load_metadata_title &&
@@ -390,7 +432,50 @@ static void load_metadata(DBusMessageIter *iter, struct mpris_metadata *track, s
     }
 }
 
-static void get_player_identity(DBusConnection *conn, const char *destination, char *identity)
+static void mpris_player_loaded(struct mpris_player*);
+static void player_identity_loaded(DBusPendingCall *pending, void *data)
+{
+    assert(data);
+    struct mpris_player *player = data;
+
+    DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
+    player->identity_call = NULL;
+    if (NULL == reply) { goto _loaded; }
+
+    DBusMessageIter rootIter;
+
+    DBusError err = {0};
+    dbus_error_init(&err);
+    const char *value = NULL;
+    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+        dbus_set_error_from_message(&err, reply);
+    } else if (dbus_message_iter_init(reply, &rootIter)) {
+        extract_string_var(&rootIter, &value, &err);
+    }
+    if (NULL != value) {
+        strncpy(player->name, value, MAX_PROPERTY_LENGTH);
+    }
+    if (dbus_error_is_set(&err)) {
+        _error("  mpris::failed_to_load_player_name: %s", err.message);
+        dbus_error_free(&err);
+    } else {
+        if (strlen(player->name) == 0) {
+            _error("mpris::empty_player_name: unable to load");
+        } else {
+            _trace("mpris::player_name: %s", player->name);
+        }
+    }
+    dbus_message_unref(reply);
+
+_loaded:
+    mpris_player_loaded(player);
+}
+
+/*
+ * Asks the player for its name, the reply is loaded by player_identity_loaded
+ */
+static void load_player_identity(DBusConnection *conn, const char *destination, struct mpris_player *player)
 {
     if (NULL == conn) { return; }
     if (NULL == destination) { return; }
@@ -403,7 +488,7 @@ static void get_player_identity(DBusConnection *conn, const char *destination, c
 
     // create a new method call and check for errors
     DBusMessage *msg = dbus_message_new_method_call(destination, path, interface, method);
-    if (NULL == msg) { return /*NULL*/; }
+    if (NULL == msg) { return; }
 
     DBusMessageIter params;
     // append interface we want to get the property from
@@ -417,49 +502,11 @@ static void get_player_identity(DBusConnection *conn, const char *destination, c
         goto _unref_message_err;
     }
 
-    DBusPendingCall *pending;
-    // send message and get a handle for a reply
-    if (!dbus_connection_send_with_reply (conn, msg, &pending, DBUS_CONNECTION_TIMEOUT)) {
-        goto _unref_message_err;
-    }
-    if (NULL == pending) {
-        goto _unref_message_err;
-    }
-    dbus_connection_flush(conn);
-
-    // block until we receive a reply
-    dbus_pending_call_block(pending);
-    DBusMessage *reply;
-    // get the reply message
-    reply = dbus_pending_call_steal_reply(pending);
-    if (NULL == reply) { goto _unref_pending_err; }
+    player->identity_call = send_dbus_message_async(conn, msg, player_identity_loaded, player);
 
-    DBusMessageIter rootIter;
-
-    DBusError err = {0};
-    dbus_error_init(&err);
-    if (dbus_message_iter_init(reply, &rootIter)) {
-        extract_string_var(&rootIter, identity, &err);
-    }
-    if (dbus_error_is_set(&err)) {
-        _error("  mpris::failed_to_load_player_name: %s", err.message);
-        dbus_error_free(&err);
-    } else {
-        if (strlen(identity) == 0) {
-            _error("mpris::empty_player_name: unable to load");
-        } else {
-            _trace("mpris::player_name: %s", identity);
-        }
-    }
-
-    dbus_message_unref(reply);
-_unref_pending_err:
-    // free the pending message handle
-    dbus_pending_call_unref(pending);
 _unref_message_err:
     // free message
     dbus_message_unref(msg);
-    return;
 }
 
 #if 0
@@ -479,11 +526,11 @@ static char *get_dbus_string_scalar(DBusMessage *message)
 }
 #endif
 
-int load_player_namespaces(DBusConnection *conn, struct mpris_player *players, int max_player_count)
+struct mpris_player **load_player_namespaces(DBusConnection *conn)
 {
-    if (NULL == conn) { return -1; }
+    if (NULL == conn) { return NULL; }
 
-    int count = 0;
+    struct mpris_player **players = NULL;
     const char *mpris_namespace = MPRIS_PLAYER_NAMESPACE;
     // get the reply message
     DBusMessage *reply = call_dbus_method(conn, DBUS_INTERFACE_DBUS, DBUS_PATH, DBUS_INTERFACE_DBUS, DBUS_METHOD_LIST_NAMES);
@@ -494,13 +541,15 @@ int load_player_namespaces(DBusConnection *conn, struct mpris_player *players, i
             DBusMessageIter arrayElementIter;
 
             dbus_message_iter_recurse(&rootIter, &arrayElementIter);
-            while (dbus_message_iter_has_next(&arrayElementIter)) {
+            while (DBUS_TYPE_INVALID != dbus_message_iter_get_arg_type(&arrayElementIter)) {
                 if (DBUS_TYPE_STRING == dbus_message_iter_get_arg_type(&arrayElementIter)) {
                     char *value = NULL;
                     dbus_message_iter_get_basic(&arrayElementIter, &value);
                     if (strncmp(value, mpris_namespace, strlen(mpris_namespace)) == 0) {
-                        strncpy(players[count].mpris_name, value, MAX_PROPERTY_LENGTH);
-                        count++;
+                        struct mpris_player *player = mpris_player_new();
+                        if (NULL == player) { break; }
+                        strncpy(player->mpris_name, value, MAX_PROPERTY_LENGTH);
+                        arrput(players, player);
                     }
                 }
                 dbus_message_iter_next(&arrayElementIter);
@@ -509,21 +558,43 @@ int load_player_namespaces(DBusConnection *conn, struct mpris_player *players, i
     }
     dbus_message_unref(reply);
 
-    // iterate over the namespaces and also load unique bus ids
-    for (int i = 0; i < count; i++) {
-        struct mpris_player *player = &players[i];
+    // load the unique bus ids from the bus rather than the players, so a player which doesn't
+    // respond can't hold us up: the calls are all sent first, so they share a single deadline
+    DBusPendingCall **calls = NULL;
+    for (int i = 0; i < arrlen(players); i++) {
+        DBusPendingCall *pending = NULL;
         // create a new method call and check for errors
-        DBusMessage *reply = call_dbus_method(conn, player->mpris_name, MPRIS_PLAYER_PATH, DBUS_INTERFACE_PEER, DBUS_METHOD_PING);
-        if (NULL != reply) {
-            const char *bus_id = dbus_message_get_sender(reply);
-            if (NULL != bus_id) {
-                memcpy(&player->bus_id, bus_id, strlen(bus_id));
+        DBusMessage *msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, DBUS_METHOD_GET_NAME_OWNER);
+        if (NULL != msg) {
+            const char *mpris_name = players[i]->mpris_name;
+            if (dbus_message_append_args(msg, DBUS_TYPE_STRING, &mpris_name, DBUS_TYPE_INVALID) &&
+                !dbus_connection_send_with_reply(conn, msg, &pending, DBUS_CONNECTION_TIMEOUT)) {
+                pending = NULL;
             }
+            dbus_message_unref(msg);
+        }
+        arrput(calls, pending);
+    }
+    dbus_connection_flush(conn);
+
+    for (int i = 0; i < arrlen(calls); i++) {
+        DBusPendingCall *pending = calls[i];
+        if (NULL == pending) { continue; }
+
+        dbus_pending_call_block(pending);
+        DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+        dbus_pending_call_unref(pending);
+        if (NULL == reply) { continue; }
+
+        const char *bus_id = NULL;
+        if (dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &bus_id, DBUS_TYPE_INVALID) && NULL != bus_id) {
+            strncpy(players[i]->bus_id, bus_id, MAX_PROPERTY_LENGTH);
         }
         // free reply
         dbus_message_unref(reply);
     }
-    return count;
+    arrfree(calls);
+    return players;
 }
 
 static void print_mpris_properties(const struct mpris_properties *properties, enum log_levels level, const struct mpris_event *changes)
@@ -569,59 +640,59 @@ static void print_mpris_properties(const struct mpris_properties *properties, en
     if (whats_loaded & mpris_load_metadata_bitrate) {
         _log(level, "     metadata::bitrate: %" PRId32, properties->metadata.bitrate);
     }
-    if (whats_loaded & mpris_load_metadata_art_url && strlen(properties->metadata.art_url) > 0) {
+    if (whats_loaded & mpris_load_metadata_art_url && NULL != properties->metadata.art_url) {
         _log(level, "     metadata::art_url: %s", properties->metadata.art_url);
     }
     if (whats_loaded & mpris_load_metadata_length) {
         _log(level, "     metadata::length: %" PRId64, properties->metadata.length);
     }
-    if (whats_loaded & mpris_load_metadata_track_id && strlen(properties->metadata.track_id) > 0) {
+    if (whats_loaded & mpris_load_metadata_track_id && NULL != properties->metadata.track_id) {
         _log(level, "     metadata::track_id: %s", properties->metadata.track_id);
     }
-    if (whats_loaded & mpris_load_metadata_album && strlen(properties->metadata.album) > 0) {
+    if (whats_loaded & mpris_load_metadata_album && NULL != properties->metadata.album) {
         _log(level, "     metadata::album: %s", properties->metadata.album);
     }
     int cnt = MAX_PROPERTY_COUNT;
 
     char temp[MAX_PROPERTY_LENGTH*MAX_PROPERTY_COUNT+9] = {0};
-    if (whats_loaded & mpris_load_metadata_album_artist && strlen(properties->metadata.album_artist[0]) > 0) {
+    if (whats_loaded & mpris_load_metadata_album_artist && NULL != properties->metadata.album_artist[0]) {
         array_log_with_label(temp, properties->metadata.album_artist, cnt);
         _log(level, "     metadata::album_artist: %s", temp);
     }
-    if (whats_loaded & mpris_load_metadata_artist && strlen(properties->metadata.artist[0]) > 0) {
+    if (whats_loaded & mpris_load_metadata_artist && NULL != properties->metadata.artist[0]) {
         array_log_with_label(temp, properties->metadata.artist, cnt); 
         _log(level, "     metadata::artist: %s", temp);
     }
-    if (whats_loaded & mpris_load_metadata_comment && strlen(properties->metadata.comment[0]) > 0) {
+    if (whats_loaded & mpris_load_metadata_comment && NULL != properties->metadata.comment[0]) {
         array_log_with_label(temp, properties->metadata.comment, cnt);
         _log(level, "     metadata::comment: %s", temp);
     }
-    if (whats_loaded & mpris_load_metadata_title && strlen(properties->metadata.title) > 0) {
+    if (whats_loaded & mpris_load_metadata_title && NULL != properties->metadata.title) {
         _log(level, "     metadata::title: %s", properties->metadata.title);
     }
     if (whats_loaded & mpris_load_metadata_track_number) {
         _log(level, "     metadata::track_number: %2" PRId32, properties->metadata.track_number);
     }
-    if (whats_loaded & mpris_load_metadata_url && strlen(properties->metadata.url) > 0) {
+    if (whats_loaded & mpris_load_metadata_url && NULL != properties->metadata.url) {
         _log(level, "     metadata::url: %s", properties->metadata.url);
     }
-    if (whats_loaded & mpris_load_metadata_genre && strlen(properties->metadata.genre[0]) > 0) {
+    if (whats_loaded & mpris_load_metadata_genre && NULL != properties->metadata.genre[0]) {
         array_log_with_label(temp, properties->metadata.genre, cnt);
         _log(level, "     metadata::genre: %s", temp);
     }
-    if (whats_loaded & mpris_load_metadata_mb_track_id && strlen(properties->metadata.mb_track_id[0]) > 0) {
+    if (whats_loaded & mpris_load_metadata_mb_track_id && NULL != properties->metadata.mb_track_id[0]) {
         array_log_with_label(temp, properties->metadata.mb_track_id, cnt);
         _log(level, "     metadata::musicbrainz::track_id: %s", temp);
     }
-    if (whats_loaded & mpris_load_metadata_mb_album_id && strlen(properties->metadata.mb_album_id[0]) > 0) {
+    if (whats_loaded & mpris_load_metadata_mb_album_id && NULL != properties->metadata.mb_album_id[0]) {
         array_log_with_label(temp, properties->metadata.mb_album_id, cnt);
         _log(level, "     metadata::musicbrainz::album_id: %s", temp);
     }
-    if (whats_loaded & mpris_load_metadata_mb_artist_id && strlen(properties->metadata.mb_artist_id[0]) > 0) {
+    if (whats_loaded & mpris_load_metadata_mb_artist_id && NULL != properties->metadata.mb_artist_id[0]) {
         array_log_with_label(temp, properties->metadata.mb_artist_id, cnt);
         _log(level, "     metadata::musicbrainz::artist_id: %s", temp);
     }
-    if (whats_loaded & mpris_load_metadata_mb_album_artist_id && strlen(properties->metadata.mb_album_artist_id[0]) > 0) {
+    if (whats_loaded & mpris_load_metadata_mb_album_artist_id && NULL != properties->metadata.mb_album_artist_id[0]) {
         array_log_with_label(temp, properties->metadata.mb_album_artist_id, cnt);
         _log(level, "     metadata::musicbrainz::album_artist_id: %s", temp);
     }
@@ -640,12 +711,13 @@ static void print_mpris_player(const struct mpris_player *pl, enum log_levels le
     print_mpris_properties(&pl->properties, level, &e);
 }
 
-static void print_mpris_players(struct mpris_player *players, int player_count, enum log_levels level)
+static void print_mpris_players(struct mpris_player **players, enum log_levels level)
 {
+    int player_count = arrlen(players);
     for (int i = 0; i < player_count; i++) {
-        struct mpris_player pl = players[i];
-        _log(level, "  player[%d:%d]: %s %s", i, player_count, pl.mpris_name, pl.bus_id);
-        print_mpris_player(&pl, level, true);
+        const struct mpris_player *pl = players[i];
+        _log(level, "  player[%d:%d]: %s %s", i, player_count, pl->mpris_name, pl->bus_id);
+        print_mpris_player(pl, level, true);
     }
 }
 
@@ -660,12 +732,14 @@ static void load_properties(DBusMessageIter *rootIter, struct mpris_properties *
     if (DBUS_TYPE_ARRAY != dbus_message_iter_get_arg_type(rootIter)) {
         return;
     }
-    if (dbus_message_iter_get_element_count(rootIter) == 0) {
-        return;
-    }
 
+    // the iterators are only moved forward: counting the elements or peeking at the next one
+    // walks the message again, which costs more than the rest for the frequent position updates
     DBusMessageIter arrayElementIter;
     dbus_message_iter_recurse(rootIter, &arrayElementIter);
+    if (DBUS_TYPE_INVALID == dbus_message_iter_get_arg_type(&arrayElementIter)) {
+        return;
+    }
 
     while (true) {
         if (DBUS_TYPE_DICT_ENTRY != dbus_message_iter_get_arg_type(&arrayElementIter)) {
@@ -683,10 +757,9 @@ static void load_properties(DBusMessageIter *rootIter, struct mpris_properties *
         char *key = NULL;
         dbus_message_iter_get_basic(&dictIter, &key);
 
-        if (!dbus_message_iter_has_next(&dictIter)) {
+        if (!dbus_message_iter_next(&dictIter)) {
             break;
         }
-        dbus_message_iter_next(&dictIter);
 
         if (!strncmp(key, MPRIS_PNAME_CANCONTROL, strlen(MPRIS_PNAME_CANCONTROL))) {
             extract_boolean_var(&dictIter, &properties->can_control, &err);
@@ -707,10 +780,10 @@ static void load_properties(DBusMessageIter *rootIter, struct mpris_properties *
             extract_boolean_var(&dictIter, &properties->can_seek, &err);
             changes->loaded_state |= mpris_load_property_can_seek;
         } else if (!strncmp(key, MPRIS_PNAME_LOOPSTATUS, strlen(MPRIS_PNAME_LOOPSTATUS))) {
-            extract_string_var(&dictIter, properties->loop_status, &err);
+            extract_status_var(&dictIter, properties->loop_status, &err);
             changes->loaded_state |= mpris_load_property_loop_status;
         } else if (!strncmp(key, MPRIS_PNAME_PLAYBACKSTATUS, strlen(MPRIS_PNAME_PLAYBACKSTATUS))) {
-            extract_string_var(&dictIter, properties->playback_status, &err);
+            extract_status_var(&dictIter, properties->playback_status, &err);
             changes->playback_status_changed = true;
             changes->player_state = get_mpris_playback_status(properties);
             changes->loaded_state |= mpris_load_property_playback_status;
@@ -732,10 +805,9 @@ static void load_properties(DBusMessageIter *rootIter, struct mpris_properties *
             _warn("dbus::value_error: %s", err.message);
             dbus_error_free(&err);
         }
-        if (!dbus_message_iter_has_next(&arrayElementIter)) {
+        if (!dbus_message_iter_next(&arrayElementIter)) {
             break;
         }
-        dbus_message_iter_next(&arrayElementIter);
     }
     if (changes->loaded_state != mpris_load_nothing) {
         changes->timestamp = time(0);
@@ -756,9 +828,70 @@ static void load_properties(DBusMessageIter *rootIter, struct mpris_properties *
         } \
     }
 
+#define _string_if_changed(a, b, whats_loaded, bitflag, strings_changed) \
+    if (whats_loaded & bitflag) { \
+        if (mpris_string_equals(a, b)) { \
+            _neg(whats_loaded, bitflag); \
+        } else { \
+            strings_changed = true; \
+        } \
+    }
+
+#define _string_array_if_changed(a, b, whats_loaded, bitflag, strings_changed) \
+    if (whats_loaded & bitflag) { \
+        if (mpris_string_array_equals(a, b)) { \
+            _neg(whats_loaded, bitflag); \
+        } else { \
+            strings_changed = true; \
+        } \
+    }
+
+static const char *store_string(struct arena *a, const char *old, const char *new, bool loaded)
+{
+    return arena_strdup(a, loaded ? new : old);
+}
+
+static void store_string_array(struct arena *a, const char *old[MAX_PROPERTY_COUNT], const char *const new[MAX_PROPERTY_COUNT], bool loaded)
+{
+    for (int i = 0; i < MAX_PROPERTY_COUNT; i++) {
+        old[i] = arena_strdup(a, loaded ? new[i] : old[i]);
+    }
+}
+
+/*
+ * Copies the metadata strings into the spare arena, taking the changed ones from the new metadata,
+ * then swaps it with the current one, which gets reset.
+ * This happens on track changes, signals which don't change anything don't copy strings.
+ */
+static void store_metadata_strings(struct mpris_properties *oldp, const struct mpris_metadata *newm, unsigned whats_loaded)
+{
+    struct arena *a = &oldp->spare;
+    struct mpris_metadata *m = &oldp->metadata;
+
+    m->track_id = store_string(a, m->track_id, newm->track_id, whats_loaded & mpris_load_metadata_track_id);
+    m->album = store_string(a, m->album, newm->album, whats_loaded & mpris_load_metadata_album);
+    m->title = store_string(a, m->title, newm->title, whats_loaded & mpris_load_metadata_title);
+    m->url = store_string(a, m->url, newm->url, whats_loaded & mpris_load_metadata_url);
+    m->art_url = store_string(a, m->art_url, newm->art_url, whats_loaded & mpris_load_metadata_art_url);
+    store_string_array(a, m->genre, newm->genre, whats_loaded & mpris_load_metadata_genre);
+    store_string_array(a, m->comment, newm->comment, whats_loaded & mpris_load_metadata_comment);
+    store_string_array(a, m->artist, newm->artist, whats_loaded & mpris_load_metadata_artist);
+    store_string_array(a, m->album_artist, newm->album_artist, whats_loaded & mpris_load_metadata_album_artist);
+    store_string_array(a, m->mb_track_id, newm->mb_track_id, whats_loaded & mpris_load_metadata_mb_track_id);
+    store_string_array(a, m->mb_album_id, newm->mb_album_id, whats_loaded & mpris_load_metadata_mb_album_id);
+    store_string_array(a, m->mb_artist_id, newm->mb_artist_id, whats_loaded & mpris_load_metadata_mb_artist_id);
+    store_string_array(a, m->mb_album_artist_id, newm->mb_album_artist_id, whats_loaded & mpris_load_metadata_mb_album_artist_id);
+
+    struct arena previous = oldp->strings;
+    oldp->strings = oldp->spare;
+    oldp->spare = previous;
+    arena_reset(&oldp->spare);
+}
+
 static void load_properties_if_changed(struct mpris_properties *oldp, const struct mpris_properties *newp, struct mpris_event *changed)
 {
     unsigned whats_loaded = changed->loaded_state;
+    bool strings_changed = false;
     _copy_if_changed(oldp->can_control, newp->can_control, whats_loaded, mpris_load_property_can_control);
     _copy_if_changed(oldp->can_go_next, newp->can_go_next, whats_loaded, mpris_load_property_can_go_next);
     _copy_if_changed(oldp->can_go_previous, newp->can_go_previous, whats_loaded, mpris_load_property_can_go_previous);
@@ -771,31 +904,98 @@ static void load_properties_if_changed(struct mpris_properties *oldp, const stru
     _copy_if_changed(oldp->shuffle, newp->shuffle, whats_loaded, mpris_load_property_shuffle);
     _copy_if_changed(oldp->volume, newp->volume, whats_loaded, mpris_load_property_volume);
     _copy_if_changed(oldp->metadata.bitrate, newp->metadata.bitrate, whats_loaded, mpris_load_metadata_bitrate);
-    _copy_if_changed(oldp->metadata.art_url, newp->metadata.art_url, whats_loaded, mpris_load_metadata_art_url);
+    _string_if_changed(oldp->metadata.art_url, newp->metadata.art_url, whats_loaded, mpris_load_metadata_art_url, strings_changed);
     _copy_if_changed(oldp->metadata.length, newp->metadata.length, whats_loaded, mpris_load_metadata_length);
-    _copy_if_changed(oldp->metadata.track_id, newp->metadata.track_id, whats_loaded, mpris_load_metadata_track_id);
-    _copy_if_changed(oldp->metadata.album, newp->metadata.album, whats_loaded, mpris_load_metadata_album);
-    _copy_if_changed(oldp->metadata.album_artist, newp->metadata.album_artist, whats_loaded, mpris_load_metadata_album_artist);
-    _copy_if_changed(oldp->metadata.artist, newp->metadata.artist, whats_loaded, mpris_load_metadata_artist);
-    _copy_if_changed(oldp->metadata.comment, newp->metadata.comment, whats_loaded, mpris_load_metadata_comment);
-    _copy_if_changed(oldp->metadata.title, newp->metadata.title, whats_loaded, mpris_load_metadata_title);
+    _string_if_changed(oldp->metadata.track_id, newp->metadata.track_id, whats_loaded, mpris_load_metadata_track_id, strings_changed);
+    _string_if_changed(oldp->metadata.album, newp->metadata.album, whats_loaded, mpris_load_metadata_album, strings_changed);
+    _string_array_if_changed(oldp->metadata.album_artist, newp->metadata.album_artist, whats_loaded, mpris_load_metadata_album_artist, strings_changed);
+    _string_array_if_changed(oldp->metadata.artist, newp->metadata.artist, whats_loaded, mpris_load_metadata_artist, strings_changed);
+    _string_array_if_changed(oldp->metadata.comment, newp->metadata.comment, whats_loaded, mpris_load_metadata_comment, strings_changed);
+    _string_if_changed(oldp->metadata.title, newp->metadata.title, whats_loaded, mpris_load_metadata_title, strings_changed);
     _copy_if_changed(oldp->metadata.track_number, newp->metadata.track_number, whats_loaded, mpris_load_metadata_track_number);
-    _copy_if_changed(oldp->metadata.url, newp->metadata.url, whats_loaded, mpris_load_metadata_url);
-    _copy_if_changed(oldp->metadata.genre, newp->metadata.genre, whats_loaded, mpris_load_metadata_genre);
-    _copy_if_changed(oldp->metadata.mb_track_id, newp->metadata.mb_track_id, whats_loaded, mpris_load_metadata_mb_track_id);
-    _copy_if_changed(oldp->metadata.mb_album_id, newp->metadata.mb_album_id, whats_loaded, mpris_load_metadata_mb_album_id);
-    _copy_if_changed(oldp->metadata.mb_artist_id, newp->metadata.mb_artist_id, whats_loaded, mpris_load_metadata_mb_artist_id);
-    _copy_if_changed(oldp->metadata.mb_album_artist_id, newp->metadata.mb_album_artist_id, whats_loaded, mpris_load_metadata_mb_album_artist_id);
+    _string_if_changed(oldp->metadata.url, newp->metadata.url, whats_loaded, mpris_load_metadata_url, strings_changed);
+    _string_array_if_changed(oldp->metadata.genre, newp->metadata.genre, whats_loaded, mpris_load_metadata_genre, strings_changed);
+    _string_array_if_changed(oldp->metadata.mb_track_id, newp->metadata.mb_track_id, whats_loaded, mpris_load_metadata_mb_track_id, strings_changed);
+    _string_array_if_changed(oldp->metadata.mb_album_id, newp->metadata.mb_album_id, whats_loaded, mpris_load_metadata_mb_album_id, strings_changed);
+    _string_array_if_changed(oldp->metadata.mb_artist_id, newp->metadata.mb_artist_id, whats_loaded, mpris_load_metadata_mb_artist_id, strings_changed);
+    _string_array_if_changed(oldp->metadata.mb_album_artist_id, newp->metadata.mb_album_artist_id, whats_loaded, mpris_load_metadata_mb_album_artist_id, strings_changed);
+    if (strings_changed) {
+        store_metadata_strings(oldp, &newp->metadata, whats_loaded);
+    }
+    // the track changed only if the fields identifying it did, and not just their case or spacing
+    changed->track_changed = false;
+    if (whats_loaded & mpris_load_track) {
+        uint64_t fingerprint = mpris_metadata_fingerprint(&oldp->metadata);
+        changed->track_changed = fingerprint != oldp->metadata.fingerprint;
+        oldp->metadata.fingerprint = fingerprint;
+    }
     changed->loaded_state = whats_loaded;
 }
 
+static void player_properties_loaded(DBusPendingCall *pending, void *data)
+{
+    assert(data);
+    struct mpris_player *player = data;
+
+    DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
+    player->properties_call = NULL;
+    if (NULL == reply) { goto _loaded; }
+
+    DBusError err = {0};
+    dbus_error_init(&err);
+
+    struct mpris_properties properties = {0};
+    struct mpris_event changes = {0};
+    DBusMessageIter rootIter;
+    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+        dbus_set_error_from_message(&err, reply);
+    } else if (dbus_message_iter_init(reply, &rootIter) && DBUS_TYPE_ARRAY == dbus_message_iter_get_arg_type(&rootIter)) {
+        load_properties(&rootIter, &properties, &changes);
+    }
+    if (dbus_error_is_set(&err)) {
+        _error("mpris::loading_properties_error: %s", err.message);
+        dbus_error_free(&err);
+    }
+
+    load_properties_if_changed(&player->properties, &properties, &changes);
+    player->changed.loaded_state |= changes.loaded_state;
+    player->changed.track_changed |= changes.track_changed;
+
+    dbus_message_unref(reply);
+
+_loaded:
+    mpris_player_loaded(player);
+}
+
+/*
+ * Subscribes to, or unsubscribes from, the PropertiesChanged signals of the player. The rules are
+ * sent without waiting for the bus, which handles them before any call we make afterwards.
+ */
+static void player_properties_match(struct mpris_player *player, bool add)
+{
+    if (NULL == player->conn || player->properties_matched == add) { return; }
+
+    char rule[MAX_PROPERTY_LENGTH * 2] = {0};
+    snprintf(rule, sizeof(rule), DBUS_MATCH_PROPERTIES_CHANGED ",sender='%s'", player->bus_id);
+    if (add) {
+        dbus_bus_add_match(player->conn, rule, NULL);
+    } else {
+        dbus_bus_remove_match(player->conn, rule, NULL);
+    }
+    player->properties_matched = add;
+    _trace("dbus::%s_match: %s", add ? "add" : "remove", rule);
+}
+
+/*
+ * Asks the player for all its properties, the reply is loaded by player_properties_loaded
+ */
 void load_player_mpris_properties(DBusConnection *conn, struct mpris_player *player)
 {
     if (NULL == conn) { return; }
     if (NULL == player) { return; }
 
     DBusMessage *msg;
-    DBusPendingCall *pending;
     DBusMessageIter params;
 
     const char *interface = DBUS_INTERFACE_PROPERTIES;
@@ -817,45 +1017,8 @@ void load_player_mpris_properties(DBusConnection *conn, struct mpris_player *pla
         goto _unref_message_err;
     }
 
-    // send message and get a handle for a reply
-    if (!dbus_connection_send_with_reply (conn, msg, &pending, DBUS_CONNECTION_TIMEOUT)) {
-        goto _unref_message_err;
-    }
-    if (NULL == pending) {
-        goto _unref_message_err;
-    }
-    dbus_connection_flush(conn);
-    // block until we receive a reply
-    dbus_pending_call_block(pending);
-
-    DBusError err = {0};
-    dbus_error_init(&err);
-
-    DBusMessage *reply;
+    player->properties_call = send_dbus_message_async(conn, msg, player_properties_loaded, player);
 
-    struct mpris_properties properties = {0};
-    struct mpris_event changes = {0};
-    // get the reply message
-    reply = dbus_pending_call_steal_reply(pending);
-    if (NULL == reply) {
-        goto _unref_pending_err;
-    }
-    DBusMessageIter rootIter;
-    if (dbus_message_iter_init(reply, &rootIter) && DBUS_TYPE_ARRAY == dbus_message_iter_get_arg_type(&rootIter)) {
-        load_properties(&rootIter, &properties, &changes);
-    }
-    if (dbus_error_is_set(&err)) {
-        _error("mpris::loading_properties_error: %s", err.message);
-        dbus_error_free(&err);
-    }
-
-    load_properties_if_changed(&player->properties, &properties, &changes);
-    player->changed.loaded_state |= changes.loaded_state;
-
-    dbus_message_unref(reply);
-_unref_pending_err:
-    // free the pending message handle
-    dbus_pending_call_unref(pending);
 _unref_message_err:
     // free message
     dbus_message_unref(msg);
@@ -882,16 +1045,15 @@ void check_for_player(DBusConnection *conn, char **destination, time_t *last_loa
 }
 #endif
 
-static int load_player_identity_from_message(DBusMessage *msg, struct mpris_player *player)
+/*
+ * The loaded names are borrowed from the message
+ */
+static int load_player_identity_from_message(DBusMessage *msg, const char **mpris_name, const char **bus_id)
 {
     if (NULL == msg) {
         _warn("dbus::invalid_signal_message(%p)", msg);
         return false;
     }
-    if (NULL == player) {
-        _warn("dbus::invalid_player_target(%p)", player);
-        return false;
-    }
     DBusError err = {0};
     dbus_error_init(&err);
 
@@ -910,25 +1072,24 @@ static int load_player_identity_from_message(DBusMessage *msg, struct mpris_play
         return 0;
     }
 
-    int len_initial = strlen(initial);
     int len_old = strlen(old_name);
     int len_new = strlen(new_name);
     if (strncmp(initial, MPRIS_PLAYER_NAMESPACE, strlen(MPRIS_PLAYER_NAMESPACE)) == 0) {
-        memcpy(player->mpris_name, initial, len_initial);
+        *mpris_name = initial;
         if (len_new == 0 && len_old > 0) {
             loaded = -1;
-            memcpy(player->bus_id, old_name, len_old);
+            *bus_id = old_name;
         }
         if (len_new > 0 && len_old == 0) {
             loaded = 1;
-            memcpy(player->bus_id, new_name, len_new);
+            *bus_id = new_name;
         }
     }
 
     return loaded;
 }
 
-static bool load_properties_from_message(DBusMessage *msg, struct mpris_properties *data, struct mpris_event *changes, const struct mpris_player players[MAX_PLAYERS], const int players_count)
+static bool load_properties_from_message(DBusMessage *msg, struct mpris_properties *data, struct mpris_event *changes)
 {
     if (NULL == msg) {
         _warn("dbus::invalid_signal_message(%p)", msg);
@@ -939,24 +1100,14 @@ static bool load_properties_from_message(DBusMessage *msg, struct mpris_properti
         _warn("dbus::invalid_properties_target(%p)", data);
         return false;
     }
-    const char *bus_id = dbus_message_get_sender(msg);
-    if (NULL != bus_id) {
-        memcpy(&changes->sender_bus_id, bus_id, strlen(bus_id));
-    }
-    for (int i = 0; i < players_count; i++) {
-        const struct mpris_player player = players[i];
-        if ( !strncmp(player.bus_id, changes->sender_bus_id, sizeof(changes->sender_bus_id)) && player.ignored) {
-            _trace("dbus::ignored_player: %s", player.name);
-            return false;
-        }
-    }
+    changes->sender_bus_id = dbus_message_get_sender(msg);
     DBusMessageIter args;
     // read the parameters
     const char *signal_name = dbus_message_get_member(msg);
     if (!dbus_message_iter_init(msg, &args)) {
         _warn("dbus::missing_signal_args: %s", signal_name);
     }
-    _trace2("dbus::signal(%p): %s:%s:%s.%s", msg, changes->sender_bus_id, dbus_message_get_path(msg), dbus_message_get_interface(msg), signal_name);
+    _trace2("dbus::signal(%p): %s:%s:%s.%s", msg, _str(changes->sender_bus_id), dbus_message_get_path(msg), dbus_message_get_interface(msg), signal_name);
     // skip first arg and then load properties from all the remaining ones
     if (DBUS_TYPE_STRING == dbus_message_iter_get_arg_type(&args)) {
         dbus_message_iter_get_basic(&args, &interface);
@@ -972,13 +1123,9 @@ static bool load_properties_from_message(DBusMessage *msg, struct mpris_properti
     if (strncmp(interface, MPRIS_PLAYER_NAMESPACE, strlen(MPRIS_PLAYER_NAMESPACE)) != 0) {
         return false;
     }
-    while (true) {
+    do {
         load_properties(&args, data, changes);
-        if (!dbus_message_iter_has_next(&args)) {
-            break;
-        }
-        dbus_message_iter_next(&args);
-    }
+    } while (dbus_message_iter_next(&args));
 
     return !(changes->loaded_state == temp);
 }
@@ -999,7 +1146,8 @@ static void dispatch(int fd, short ev, void *data)
 static void handle_dispatch_status(DBusConnection *conn, DBusDispatchStatus status, void *data)
 {
     struct state *s = data;
-    if (status == DBUS_DISPATCH_DATA_REMAINS) {
+    // re-adding the pending dispatch would push it back with every new message
+    if (status == DBUS_DISPATCH_DATA_REMAINS && !event_pending(&s->events.dispatch, EV_TIMEOUT, NULL)) {
         struct timeval tv = { .tv_sec = 0, .tv_usec = 300000, };
         event_add (&s->events.dispatch, &tv);
         _trace2("dbus::new_dispatch_status(%p): %s", (void*)conn, "DATA_REMAINS");
@@ -1018,6 +1166,7 @@ static void handle_watch(int fd, short events, void *data)
 
     struct state *state = data;
     DBusWatch *watch = state->dbus->watch;
+    state->dbus->wakeups++;
 
     unsigned flags = 0;
     if (events & EV_READ) { flags |= DBUS_WATCH_READABLE; }
@@ -1082,31 +1231,79 @@ static void toggle_watch(DBusWatch *watch, void *data)
     }
 }
 
-static int mpris_player_remove(struct mpris_player *players, int player_count, struct mpris_player player)
+/*
+ * The timeouts are for the calls we're waiting a reply for, libdbus gives them an error reply when they expire
+ */
+static void handle_timeout(int fd, short events, void *data)
 {
-    if (NULL == players) { return -1; }
-    if (player_count == 0) { return 0; }
+    assert(data);
+    struct dbus_timeout *t = data;
+    // handling it can remove the timeout
+    struct state *state = t->state;
 
-    int idx = -1;
-    for (int i = 0; i < player_count; i++) {
-        struct mpris_player *to_remove = &players[i];
-        if (strncmp(to_remove->bus_id, player.bus_id, strlen(player.bus_id)) == 0) {
-            idx = i;
-            // free player and decrease player count
-            mpris_player_free(to_remove);
-            break;
-        }
+    _trace2("dbus::handle_timeout: timeout=%p ev=%d", (void*)t->timeout, events);
+    dbus_timeout_handle(t->timeout);
+
+    // the error replies are queued without a change in the dispatch status
+    handle_dispatch_status(state->dbus->conn, DBUS_DISPATCH_DATA_REMAINS, state);
+}
+
+static unsigned add_timeout(DBusTimeout *timeout, void *data)
+{
+    if (!dbus_timeout_get_enabled(timeout)) { return true; }
+
+    struct dbus_timeout *t = dbus_timeout_get_data(timeout);
+    if (NULL == t) {
+        t = calloc(1, sizeof(struct dbus_timeout));
+        if (NULL == t) { return false; }
+        t->state = data;
+        t->timeout = timeout;
+        evtimer_assign(&t->event, t->state->events.base, handle_timeout, t);
+        dbus_timeout_set_data(timeout, t, NULL);
     }
 
-    for (int i = idx + 1; i < player_count; i++) {
-        struct mpris_player *to_move = &players[i];
-        if (NULL == to_move) {
-            continue;
+    int interval = dbus_timeout_get_interval(timeout);
+    struct timeval tv = { .tv_sec = interval / 1000, .tv_usec = (interval % 1000) * 1000, };
+    evtimer_add(&t->event, &tv);
+
+    _trace2("dbus::add_timeout: timeout=%p interval=%dms", (void*)timeout, interval);
+    return true;
+}
+
+static void remove_timeout(DBusTimeout *timeout, void *data)
+{
+    struct dbus_timeout *t = dbus_timeout_get_data(timeout);
+    if (NULL != t) {
+        evtimer_del(&t->event);
+        free(t);
+    }
+
+    dbus_timeout_set_data(timeout, NULL, NULL);
+    _trace2("dbus::removed_timeout: timeout=%p data=%p", (void*)timeout, data);
+}
+
+static void toggle_timeout(DBusTimeout *timeout, void *data)
+{
+    if (dbus_timeout_get_enabled(timeout)) {
+        add_timeout(timeout, data);
+    } else {
+        remove_timeout(timeout, data);
+    }
+}
+
+static void mpris_player_remove(struct state *s, const char *bus_id)
+{
+    struct mpris_player *player = player_index_find(&s->player_names, bus_id);
+    if (NULL == player) { return; }
+
+    player_index_remove(&s->player_names, player);
+    for (int i = 0; i < arrlen(s->players); i++) {
+        if (s->players[i] == player) {
+            arrdel(s->players, i);
+            break;
         }
-        memcpy(to_move, &players[player_count-1], sizeof(struct mpris_player));
     }
-    player_count--;
-    return player_count;
+    mpris_player_free(player);
 }
 
 static void print_properties_if_changed(struct mpris_properties *oldp, const struct mpris_properties *newp, struct mpris_event *changed, enum log_levels level)
@@ -1199,9 +1396,9 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_art_url) {
-        bool changed = !_eq(oldp->metadata.art_url, newp->metadata.art_url);
+        bool changed = !mpris_string_equals(oldp->metadata.art_url, newp->metadata.art_url);
         if (changed) {
-            _log(level, "  metadata.art_url changed: %s: '%s' - '%s'", _to_bool(changed), oldp->metadata.art_url, newp->metadata.art_url);
+            _log(level, "  metadata.art_url changed: %s: '%s' - '%s'", _to_bool(changed), _str(oldp->metadata.art_url), _str(newp->metadata.art_url));
         }
         prop_changed |= changed;
     }
@@ -1213,28 +1410,26 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_track_id) {
-        bool changed = !_eq(oldp->metadata.track_id, newp->metadata.track_id);
+        bool changed = !mpris_string_equals(oldp->metadata.track_id, newp->metadata.track_id);
         if (changed) {
-            _log(level, "  metadata.track_id changed: %s: '%s' - '%s'", _to_bool(changed), oldp->metadata.track_id, newp->metadata.track_id);
+            _log(level, "  metadata.track_id changed: %s: '%s' - '%s'", _to_bool(changed), _str(oldp->metadata.track_id), _str(newp->metadata.track_id));
         }
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_album) {
-        bool changed = !_eq(oldp->metadata.album, newp->metadata.album);
+        bool changed = !mpris_string_equals(oldp->metadata.album, newp->metadata.album);
         if (changed) {
-            _log(level, "  metadata.album changed[%zu]: %s: '%s' - '%s'", sizeof(oldp->metadata.album), _to_bool(changed), oldp->metadata.album, newp->metadata.album);
+            _log(level, "  metadata.album changed: %s: '%s' - '%s'", _to_bool(changed), _str(oldp->metadata.album), _str(newp->metadata.album));
         }
         prop_changed |= changed;
     }
     int cnt = MAX_PROPERTY_COUNT;
     char temp[MAX_PROPERTY_LENGTH*MAX_PROPERTY_COUNT+9] = {0};
     if (whats_loaded & mpris_load_metadata_album_artist) {
-        bool changed = !_eq(oldp->metadata.album_artist, newp->metadata.album_artist);
+        bool changed = !mpris_string_array_equals(oldp->metadata.album_artist, newp->metadata.album_artist);
         if (changed) {
             _log(level, "  metadata.album_artist changed: %s", _to_bool(changed));
-            const char t[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH] = {0};
-            memcpy((char**)t, oldp->metadata.album_artist, sizeof(t));
-            array_log_with_label(temp, t, cnt);
+            array_log_with_label(temp, oldp->metadata.album_artist, cnt);
             _log(level, "  from: %s", temp);
             array_log_with_label(temp, newp->metadata.album_artist, cnt);
             _log(level, "    to: %s", temp);
@@ -1242,12 +1437,10 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_artist) {
-        bool changed = !_eq(oldp->metadata.artist, newp->metadata.artist);
+        bool changed = !mpris_string_array_equals(oldp->metadata.artist, newp->metadata.artist);
         if (changed) {
             _log(level, "  metadata.artist changed: %s", _to_bool(changed));
-            const char t[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH] = {0};
-            memcpy((char**)t, oldp->metadata.artist, sizeof(t));
-            array_log_with_label(temp, t, cnt);
+            array_log_with_label(temp, oldp->metadata.artist, cnt);
             _log(level, "  from: %s", temp);
             array_log_with_label(temp, newp->metadata.artist, cnt);
             _log(level, "    to: %s", temp);
@@ -1255,12 +1448,10 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_comment) {
-        bool changed = !_eq(oldp->metadata.comment, newp->metadata.comment);
+        bool changed = !mpris_string_array_equals(oldp->metadata.comment, newp->metadata.comment);
         if (changed) {
             _log(level, "  metadata.comment changed: %s", _to_bool(changed));
-            const char t[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH] = {0};
-            memcpy((char**)t, oldp->metadata.comment, sizeof(t));
-            array_log_with_label(temp, t, cnt);
+            array_log_with_label(temp, oldp->metadata.comment, cnt);
             _log(level, "  from: %s", temp);
             array_log_with_label(temp, newp->metadata.comment, cnt);
             _log(level, "    to: %s", temp);
@@ -1268,9 +1459,9 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_title) {
-        bool changed = !_eq(oldp->metadata.title, newp->metadata.title);
+        bool changed = !mpris_string_equals(oldp->metadata.title, newp->metadata.title);
         if (changed) {
-            _log(level, "  metadata.title changed: %s: '%s' - '%s'", _to_bool(changed), oldp->metadata.title, newp->metadata.title);
+            _log(level, "  metadata.title changed: %s: '%s' - '%s'", _to_bool(changed), _str(oldp->metadata.title), _str(newp->metadata.title));
         }
         prop_changed |= changed;
     }
@@ -1282,19 +1473,17 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_url) {
-        bool changed = !_eq(oldp->metadata.url, newp->metadata.url);
+        bool changed = !mpris_string_equals(oldp->metadata.url, newp->metadata.url);
         if (changed) {
-            _log(level, "  metadata.url changed: %s: '%s' - '%s'", _to_bool(changed), oldp->metadata.url, newp->metadata.url);
+            _log(level, "  metadata.url changed: %s: '%s' - '%s'", _to_bool(changed), _str(oldp->metadata.url), _str(newp->metadata.url));
         }
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_genre) {
-        bool changed = !_eq(oldp->metadata.genre, newp->metadata.genre);
+        bool changed = !mpris_string_array_equals(oldp->metadata.genre, newp->metadata.genre);
         if (changed) {
             _log(level, "  metadata.genre changed: %s", _to_bool(changed));
-            const char t[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH] = {0};
-            memcpy((char**)t, oldp->metadata.genre, sizeof(t));
-            array_log_with_label(temp, t, cnt);
+            array_log_with_label(temp, oldp->metadata.genre, cnt);
             _log(level, "  from: %s", temp);
             array_log_with_label(temp, newp->metadata.genre, cnt);
             _log(level, "    to: %s", temp);
@@ -1302,12 +1491,10 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_mb_track_id) {
-        bool changed = !_eq(oldp->metadata.mb_track_id, newp->metadata.mb_track_id);
+        bool changed = !mpris_string_array_equals(oldp->metadata.mb_track_id, newp->metadata.mb_track_id);
         if (changed) {
             _log(level, "  metadata.mb_track_id changed: %s", _to_bool(changed));
-            const char t[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH] = {0};
-            memcpy((char**)t, oldp->metadata.mb_track_id, sizeof(t));
-            array_log_with_label(temp, t, cnt);
+            array_log_with_label(temp, oldp->metadata.mb_track_id, cnt);
             _log(level, "  from: %s", temp);
             array_log_with_label(temp, newp->metadata.mb_track_id, cnt);
             _log(level, "    to: %s", temp);
@@ -1315,12 +1502,10 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_mb_album_id) {
-        bool changed = changed;
+        bool changed = !mpris_string_array_equals(oldp->metadata.mb_album_id, newp->metadata.mb_album_id);
         if (changed) {
             _log(level, "  metadata.mb_album_id changed: %s", _to_bool(changed));
-            const char t[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH] = {0};
-            memcpy((char**)t, oldp->metadata.mb_album_id, sizeof(t));
-            array_log_with_label(temp, t, cnt);
+            array_log_with_label(temp, oldp->metadata.mb_album_id, cnt);
             _log(level, "  from: %s", temp);
             array_log_with_label(temp, newp->metadata.mb_album_id, cnt);
             _log(level, "    to: %s", temp);
@@ -1328,12 +1513,10 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_mb_artist_id) {
-        bool changed = !_eq(oldp->metadata.mb_artist_id, newp->metadata.mb_artist_id);
+        bool changed = !mpris_string_array_equals(oldp->metadata.mb_artist_id, newp->metadata.mb_artist_id);
         if (changed) {
             _log(level, "  metadata.mb_artist_id changed: %s", _to_bool(changed));
-            const char t[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH] = {0};
-            memcpy((char**)t, oldp->metadata.mb_artist_id, sizeof(t));
-            array_log_with_label(temp, t, cnt);
+            array_log_with_label(temp, oldp->metadata.mb_artist_id, cnt);
             _log(level, "  from: %s", temp);
             array_log_with_label(temp, newp->metadata.mb_artist_id, cnt);
             _log(level, "    to: %s", temp);
@@ -1341,12 +1524,10 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
         prop_changed |= changed;
     }
     if (whats_loaded & mpris_load_metadata_mb_album_artist_id) {
-        bool changed = !_eq(oldp->metadata.mb_album_artist_id, newp->metadata.mb_album_artist_id);
+        bool changed = !mpris_string_array_equals(oldp->metadata.mb_album_artist_id, newp->metadata.mb_album_artist_id);
         if (changed) {
             _log(level, "  metadata.mb_album_artist_id changed: %s", _to_bool(changed));
-            const char t[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH] = {0};
-            memcpy((char**)t, oldp->metadata.mb_album_artist_id, sizeof(t));
-            array_log_with_label(temp, t, cnt);
+            array_log_with_label(temp, oldp->metadata.mb_album_artist_id, cnt);
             _log(level, "  from: %s", temp);
             array_log_with_label(temp, newp->metadata.mb_album_artist_id, cnt);
             _log(level, "    to: %s", temp);
@@ -1359,93 +1540,67 @@ static void print_properties_if_changed(struct mpris_properties *oldp, const str
     }
 }
 
-static DBusHandlerResult add_filter(DBusConnection *conn, DBusMessage *message, void *data)
+static DBusHandlerResult filter_message(DBusConnection *conn, DBusMessage *message, struct state *s)
 {
     bool handled = false;
-    struct state *s = data;
     if (dbus_message_is_signal(message, DBUS_INTERFACE_PROPERTIES, DBUS_SIGNAL_PROPERTIES_CHANGED)) {
         if (strncmp(dbus_message_get_path(message), MPRIS_PLAYER_PATH, strlen(MPRIS_PLAYER_PATH)) == 0) {
+            const char *sender = dbus_message_get_sender(message);
+            struct mpris_player *player = player_index_find(&s->player_names, sender);
+            if (NULL == player) {
+                _trace("dbus::unknown_player: %s", _str(sender));
+                return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+            }
+            if (player->ignored) {
+                _trace("dbus::ignored_player: %s", player->name);
+                return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+            }
+
             struct mpris_properties properties = {0};
             struct mpris_event changed = {0};
-            struct mpris_player *player = NULL;
-
-            bool loaded_something = load_properties_from_message(message, &properties, &changed, s->players, s->player_count);
+            bool loaded_something = load_properties_from_message(message, &properties, &changed);
             if (loaded_something) {
-                for (int i = 0; i < s->player_count; i++) {
-                    player = &(s->players[i]);
-                    if (strncmp(player->bus_id, changed.sender_bus_id, strlen(changed.sender_bus_id))) {
-                        continue;
-                    }
-                    if (player->ignored) {
-                        break;
-                    }
-                    load_properties_if_changed(&player->properties, &properties, &changed);
-                    print_properties_if_changed(&player->properties, &properties, &changed, log_tracing);
-                    player->changed.loaded_state |= changed.loaded_state;
-                    player->changed.timestamp = changed.timestamp;
-                    handled = true;
-                    break;
-                }
-                if (!handled) {
-                    for (int i = s->player_count; i < MAX_PLAYERS; i++) {
-                        // player is not yet in list
-                        player = &(s->players[i]);
-                        if (strlen(player->bus_id) == 0) {
-                            continue;
-                        }
-                        if (strncmp(player->bus_id, changed.sender_bus_id, strlen(changed.sender_bus_id)) != 0) {
-                            continue;
-                        }
-                        if (player->ignored) {
-                            break;
-                        }
-
-                        if (mpris_player_init(s->dbus, player, s->events, &s->scrobbler, s->config->ignore_players, s->config->ignore_players_count) > 0) {
-                            assert(strlen(player->mpris_name) > 0);
-                            _debug("mpris_player::already_opened[%d]: %s%s", i, player->mpris_name, player->bus_id);
-
-                            load_properties_if_changed(&player->properties, &properties, &changed);
-                            print_properties_if_changed(&player->properties, &properties, &changed, log_tracing);
-                            player->changed.loaded_state |= changed.loaded_state;
-                            player->changed.timestamp = changed.timestamp;
-
-                            handled = true;
-                            s->player_count++;
-                        }
-                        break;
-                    }
-                }
-                if (mpris_player_is_valid(player)) {
-                    //print_mpris_player(player, log_tracing, false);
-                    state_loaded_properties(conn, player, &player->properties, &player->changed);
-                }
+                load_properties_if_changed(&player->properties, &properties, &changed);
+                print_properties_if_changed(&player->properties, &properties, &changed, log_tracing);
+                player->changed.loaded_state |= changed.loaded_state;
+                player->changed.track_changed |= changed.track_changed;
+                player->changed.timestamp = changed.timestamp;
+                handled = true;
+                mpris_player_changed(player);
             } else {
                 _warn("mpris_player::unable to load properties from message");
             }
         }
     }
     if (dbus_message_is_signal(message, DBUS_INTERFACE_DBUS, DBUS_SIGNAL_NAME_OWNER_CHANGED)) {
-        struct mpris_player temp_player = {0};
-        int loaded_or_deleted = load_player_identity_from_message(message, &temp_player);
+        const char *mpris_name = NULL;
+        const char *bus_id = NULL;
+        int loaded_or_deleted = load_player_identity_from_message(message, &mpris_name, &bus_id);
 
         handled = loaded_or_deleted != 0;
         if (loaded_or_deleted > 0) {
             // player was opened
-            // use the new pointer for inintializing the player and stuff
-            struct mpris_player *player = &s->players[s->player_count];
-            memcpy(player, &temp_player, sizeof(struct mpris_player));
-
-            mpris_player_init(s->dbus, player, s->events, &s->scrobbler, s->config->ignore_players, s->config->ignore_players_count);
-            if (mpris_player_is_valid(player)) {
-                //print_mpris_player(player, log_tracing, false);
-                state_loaded_properties(conn, player, &player->properties, &player->changed);
+            struct mpris_player *player = mpris_player_new();
+            if (NULL == player) {
+                _error("mpris_player::unable to allocate %s%s", mpris_name, bus_id);
+                return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+            }
+            strncpy(player->mpris_name, mpris_name, MAX_PROPERTY_LENGTH);
+            strncpy(player->bus_id, bus_id, MAX_PROPERTY_LENGTH);
+
+            if (mpris_player_init(s->dbus, player, s->events, &s->scrobbler, s->config) < 0) {
+                _warn("mpris_player::unable to open %s%s", mpris_name, bus_id);
+                mpris_player_free(player);
+                return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
             }
-            _info("mpris_player::opened[%d]: %s%s", s->player_count, player->mpris_name, player->bus_id);
-            s->player_count++;
+            // the player's state is loaded once it replies, see mpris_player_loaded
+            arrput(s->players, player);
+            player_index_add(&s->player_names, player);
+            _info("mpris_player::opened[%td]: %s%s", arrlen(s->players), player->mpris_name, player->bus_id);
         } else if (loaded_or_deleted < 0) {
             // player was closed
-            s->player_count = mpris_player_remove(s->players, s->player_count, temp_player);
-            _info("mpris_player::closed[%d]: %s%s", s->player_count, temp_player.mpris_name, temp_player.bus_id);
+            mpris_player_remove(s, bus_id);
+            _info("mpris_player::closed[%td]: %s%s", arrlen(s->players), mpris_name, bus_id);
         }
     }
     if (handled) {
@@ -1464,9 +1619,24 @@ static DBusHandlerResult add_filter(DBusConnection *conn, DBusMessage *message,
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
+static DBusHandlerResult add_filter(DBusConnection *conn, DBusMessage *message, void *data)
+{
+    struct state *s = data;
+    double start = monotonic_seconds();
+
+    DBusHandlerResult result = filter_message(conn, message, s);
+
+    s->dbus->received++;
+    if (result == DBUS_HANDLER_RESULT_HANDLED) { s->dbus->handled++; }
+    s->dbus->filter_time += monotonic_seconds() - start;
+    return result;
+}
+
 void dbus_close(struct state *state)
 {
     if (NULL == state->dbus) { return; }
+    const struct dbus *d = state->dbus;
+    _info("dbus::stats: %zu wakeups, %zu messages, %zu handled, %.3lfms filtering", d->wakeups, d->received, d->handled, d->filter_time * 1000);
     if (NULL != state->dbus->conn) {
         _trace2("mem::free::dbus_connection(%p)", state->dbus->conn);
         dbus_connection_flush(state->dbus->conn);
@@ -1504,15 +1674,8 @@ struct dbus *dbus_connection_init(struct state *state)
 
     event_assign(&state->events.dispatch, state->events.base, -1, EV_TIMEOUT, dispatch, conn);
 
-    const char *properties_match_signal = "type='signal',interface='" DBUS_INTERFACE_PROPERTIES "',member='" DBUS_SIGNAL_PROPERTIES_CHANGED "',path='" MPRIS_PLAYER_PATH "'";
-    dbus_bus_add_match(conn, properties_match_signal, &err);
-    _trace("dbus::add_match: %s", properties_match_signal);
-    if (dbus_error_is_set(&err)) {
-        _error("dbus::add_match: %s", err.message);
-        dbus_error_free(&err);
-        goto _cleanup;
-    }
-    const char *names_signal = "type='signal',interface='" DBUS_INTERFACE_DBUS "',member='" DBUS_SIGNAL_NAME_OWNER_CHANGED "',path='" DBUS_PATH_DBUS "'";
+    // the PropertiesChanged signals are matched for each player, once it shows up
+    const char *names_signal = DBUS_MATCH_NAME_OWNER_CHANGED;
     dbus_bus_add_match(conn, names_signal, &err);
     _trace("dbus::add_match: %s", names_signal);
     if (dbus_error_is_set(&err)) {
@@ -1531,6 +1694,11 @@ struct dbus *dbus_connection_init(struct state *state)
         goto _cleanup;
     }
 
+    if (!dbus_connection_set_timeout_functions(conn, add_timeout, remove_timeout, toggle_timeout, state, NULL)) {
+        _error("dbus::add_timeout_functions: failed");
+        goto _cleanup;
+    }
+
     dbus_connection_set_dispatch_status_function(conn, handle_dispatch_status, state, NULL);
 
     dbus_connection_set_exit_on_disconnect(conn, false);
@@ -92,8 +92,7 @@ static void send_now_playing(evutil_socket_t fd, short event, void *data)
     assert(data);
     struct event_payload *state = data;
 
-    struct scrobble *track = &state->scrobble;
-    assert(track);
+    struct scrobble *track = state->scrobble;
     if (scrobble_is_empty(track)) {
         _debug("events::now_playing: invalid scrobble %p", track);
         return;
@@ -120,7 +119,7 @@ static void send_now_playing(evutil_socket_t fd, short event, void *data)
     print_scrobble(track, log_tracing);
     if (now_playing_is_valid(track)) {
         const struct scrobble *tracks[1] = {track};
-        _info("scrobbler::now_playing[%s]: %s//%s//%s", player->name, track->title, track->artist[0], track->album);
+        _info("scrobbler::now_playing[%s]: %s//%s//%s", player->name, scrobble_title(track), scrobble_artist(track, 0), scrobble_album(track));
         // TODO(marius): this requires the number of tracks to be passed down, to avoid dependency on arrlen
         api_request_do(scrobbler, tracks, 1, api_build_request_now_playing);
     } else {
@@ -154,7 +153,10 @@ static bool add_event_now_playing(struct mpris_player *player, struct scrobble *
     struct timeval now_playing_tv = { .tv_sec = delay };
 
     struct event_payload *payload = &player->now_playing;
-    scrobble_copy(&payload->scrobble, track);
+    if (payload->scrobble != track) {
+        scrobble_free(payload->scrobble);
+        payload->scrobble = scrobble_copy(track);
+    }
 
     if (event_initialized(&payload->event)) {
         event_del(&payload->event);
@@ -167,8 +169,8 @@ static bool add_event_now_playing(struct mpris_player *player, struct scrobble *
 
     _debug("events::add_event:now_playing[%s] in %2.2lfs, elapsed %2.2lfs", player->name, timeval_to_seconds(now_playing_tv), (double)track->position);
     event_add(&payload->event, &now_playing_tv);
-    payload->scrobble.position += delay;
-    payload->scrobble.play_time += delay;
+    payload->scrobble->position += delay;
+    payload->scrobble->play_time += delay;
 
     return true;
 }
@@ -191,14 +193,14 @@ static void queue(evutil_socket_t fd, short event, void *data)
         return;
     }
 
-    struct scrobble *scrobble = &state->scrobble;
-    assert(NULL != scrobble && !scrobble_is_empty(scrobble));
+    struct scrobble *scrobble = state->scrobble;
+    assert(!scrobble_is_empty(scrobble));
     //print_scrobble(scrobble, log_tracing);
 
-    _trace("events::triggered(%p:%p):queue", state, scrobbler->queue);
+    _trace("events::triggered(%p:%p):queue", state, &scrobbler->queue);
     scrobbles_append(scrobbler, scrobble);
 
-    int queue_count = scrobbler->queue_length;
+    int queue_count = scrobble_queue_length(&scrobbler->queue);
     if (queue_count > 0) {
         queue_count -= scrobbles_consume_queue(scrobbler);
         _debug("events::new_queue_length: %zu", queue_count);
@@ -221,7 +223,10 @@ static bool add_event_queue(struct mpris_player *player, struct scrobble *track)
     }
 
     struct event_payload *payload = &player->queue;
-    scrobble_copy(&payload->scrobble, track);
+    if (payload->scrobble != track) {
+        scrobble_free(payload->scrobble);
+        payload->scrobble = scrobble_copy(track);
+    }
 
     assert(!scrobble_is_empty(track));
 
@@ -278,7 +283,7 @@ static inline bool mpris_event_changed_playback_status(const struct mpris_event
 }
 static inline bool mpris_event_changed_track(const struct mpris_event *ev)
 {
-    return ev->loaded_state > mpris_load_property_position;
+    return ev->track_changed;
 }
 static inline bool mpris_event_changed_volume(const struct mpris_event *ev)
 {
@@ -314,7 +319,7 @@ bool state_player_is_valid(struct mpris_player *player)
 bool state_is_valid(struct state *state) {
     return (
         (NULL != state) &&
-        (state->player_count > 0)/* && state_player_is_valid(state->player)*/ &&
+        (arrlen(state->players) > 0)/* && state_player_is_valid(state->player)*/ &&
         (NULL != state->dbus) && state_dbus_is_valid(state->dbus)
     );
 }
@@ -327,9 +332,8 @@ void resend_now_playing (struct state *state)
     }
     // NOTE(marius): cancel any pending connections
     scrobbler_connections_clean(&state->scrobbler);
-    for (int i = 0; i < state->player_count; i++) {
-        struct mpris_player *player = &state->players[i];
-        check_player(player);
+    for (int i = 0; i < arrlen(state->players); i++) {
+        check_player(state->players[i]);
     }
 }
 
@@ -14,6 +14,8 @@
 #include "structs.h"
 #include "sstrings.h"
 #include "utils.h"
+#include "arena.h"
+#include "scrobble_record.h"
 #include "api.h"
 #include "smpris.h"
 #include "scrobbler.h"
@@ -96,14 +98,15 @@ static void get_session(struct api_credentials *creds)
     if (strlen(creds->token) == 0) { return; }
 
     struct scrobbler_connection *conn = scrobbler_connection_new();
-    scrobbler_connection_init(conn, NULL, *creds, 0);
+    scrobbler_connection_init(conn, NULL, *creds);
     conn->request = api_build_request_get_session(creds, conn->handle);
+    http_response_expect_json(conn->response);
 
     build_curl_request(conn);
 
     enum api_return_status ok = request_call(conn);
-    if (ok == status_ok && !json_document_is_error(conn->response->body, conn->response->body_length, creds->end_point)) {
-        api_response_get_session_key_json(conn->response->body, conn->response->body_length, creds);
+    if (ok == status_ok && !json_document_is_error(conn->response->json, creds->end_point)) {
+        api_response_get_session_key_json(conn->response->json, creds);
         if (strlen(creds->session_key) > 0) {
             _info("api::get_session[%s] %s", get_api_type_label(creds->end_point), "ok");
             creds->enabled = true;
@@ -132,19 +135,20 @@ static bool get_token(struct api_credentials *creds)
     char *auth_url = NULL;
 
     struct scrobbler_connection *conn = scrobbler_connection_new();
-    scrobbler_connection_init(conn, NULL, *creds, 0);
+    scrobbler_connection_init(conn, NULL, *creds);
     conn->request = api_build_request_get_token(creds, conn->handle);
     if (NULL == conn->request) {
         _error("api::invalid_get_token_request");
     }
+    http_response_expect_json(conn->response);
 
     build_curl_request(conn);
 
     enum api_return_status ok = request_call(conn);
 
-    if (ok == status_ok && !json_document_is_error(conn->response->body, conn->response->body_length, creds->end_point)) {
+    if (ok == status_ok && !json_document_is_error(conn->response->json, creds->end_point)) {
         api_credentials_disable(creds);
-        api_response_get_token_json(conn->response->body, conn->response->body_length, creds);
+        api_response_get_token_json(conn->response->json, creds);
     }
     if (strlen(creds->token) > 0) {
         _info("api::get_token[%s] %s", get_api_type_label(creds->end_point), "ok");
@@ -65,16 +65,30 @@ bool mpris_player_is_valid(const struct mpris_player  *player)
     return strlen(player->mpris_name) > 1 && strlen(player->name) > 0 && NULL != player->scrobbler;
 }
 
+static bool mpris_string_equals(const char *s, const char *p)
+{
+    if (s == p) { return true; }
+    if (NULL == s || NULL == p) { return false; }
+    return strcmp(s, p) == 0;
+}
+
+static bool mpris_string_array_equals(const char *const s[MAX_PROPERTY_COUNT], const char *const p[MAX_PROPERTY_COUNT])
+{
+    for (int i = 0; i < MAX_PROPERTY_COUNT; i++) {
+        if (!mpris_string_equals(s[i], p[i])) { return false; }
+        if (NULL == s[i]) { break; }
+    }
+    return true;
+}
+
+static uint64_t mpris_metadata_fingerprint(const struct mpris_metadata *m)
+{
+    return track_fingerprint(m->title, m->album, m->artist, m->length / 1000000lu, m->track_number);
+}
+
 static bool mpris_metadata_equals(const struct mpris_metadata *s, const struct mpris_metadata *p)
 {
-    bool result = (
-        (!_is_zero(s->title) && !_is_zero(p->title) && _eq(s->title, p->title)) &&
-        (!_is_zero(s->album) && !_is_zero(p->album) && _eq(s->album, p->album)) &&
-        (!_is_zero(s->artist) && !_is_zero(p->artist) && _eq(s->artist, p->artist)) &&
-        (s->length == p->length) &&
-        (s->track_number == p->track_number) /*&&
-        (s->start_time == p->start_time)*/
-    );
+    bool result = s->fingerprint != 0 && s->fingerprint == p->fingerprint;
     _trace2("mpris::check_metadata(%p:%p) %s", s, p, result ? "same" : "different");
 
     return result;
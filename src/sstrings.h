@@ -13,6 +13,9 @@
 #endif
 
 #include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 
 #ifndef grrrs_std_alloc
 #include <stdlib.h>
@@ -42,6 +45,8 @@
 #define _OKP(A) (NULL != (A))
 #define _GRRRS_NULL_TOP_PTR (-2 * sizeof(uint32_t))
 
+#define GRRRS_MIN_CAPACITY 64
+
 #define _grrr_sizeof(C) (sizeof(struct grrr_string) + ((C+1) * sizeof(char)))
 
 #define grrrs_from_string(A) (_VOID(A) ? \
@@ -114,9 +119,7 @@ void __cstrncpy(char *dest, const char *src, uint32_t len)
     if (_VOID(src)) {
         return;
     }
-    for (uint32_t i = 0; i < len; i++) {
-        dest[i] = src[i];
-    }
+    memcpy(dest, src, len);
     dest[len] = '\0';
 }
 
@@ -228,6 +231,103 @@ void *_grrrs_resize(void *s, uint32_t new_cap)
     return __grrrs_resize(gs, new_cap)->data;
 }
 
+/*
+ * Makes room for at least extra more characters, growing the capacity to the next power of two,
+ * so that a string built from many appends gets copied only a logarithmic number of times.
+ */
+internal struct grrr_string *__grrrs_reserve(struct grrr_string *gs, uint32_t extra)
+{
+    uint32_t needed = gs->len + extra;
+    if (needed < gs->len) {
+        GRRRS_ERR("string length overflow %" PRIu32 " + %" PRIu32 "\n", gs->len, extra);
+        return (void*)_GRRRS_NULL_TOP_PTR;
+    }
+    if (needed <= gs->cap) { return gs; }
+
+    uint32_t new_cap = GRRRS_MIN_CAPACITY;
+    while (new_cap < needed || new_cap <= gs->cap) {
+        if (new_cap > UINT32_MAX / 2) {
+            new_cap = needed;
+            break;
+        }
+        new_cap *= 2;
+    }
+
+    struct grrr_string *result = grrrs_std_realloc(gs, _grrr_sizeof(new_cap));
+    if (_VOID(result)) {
+        GRRRS_OOM;
+        grrrs_std_free(gs);
+        return (void*)_GRRRS_NULL_TOP_PTR;
+    }
+    result->cap = new_cap;
+    return result;
+}
+
+/*
+ * Appends the first len characters of c to the string.
+ * The string can move, so the result needs to replace it: s = grrrs_append(s, c, len)
+ * On allocation failure the string is freed and NULL is returned.
+ */
+char *grrrs_append(char *s, const char *c, uint32_t len)
+{
+    if (_VOID(s)) { return s; }
+    if (_VOID(c) || len == 0) { return s; }
+
+    struct grrr_string *gs = __grrrs_reserve(_grrrs_ptr(s), len);
+    if (_VOID(gs->data)) { return NULL; }
+
+    __cstrncpy(gs->data + gs->len, c, len);
+    gs->len += len;
+
+    return gs->data;
+}
+
+#define grrrs_append_cstring(A, B) grrrs_append((A), (B), __strlen(B))
+
+/*
+ * Appends a printf style formatted value to the string, with the same semantics as grrrs_append
+ */
+char *grrrs_append_format(char *s, const char *fmt, ...)
+{
+    if (_VOID(s)) { return s; }
+    if (_VOID(fmt)) { return s; }
+
+    struct grrr_string *gs = _grrrs_ptr(s);
+
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(gs->data + gs->len, gs->cap - gs->len + 1, fmt, args);
+    va_end(args);
+    if (len < 0) {
+        GRRRS_ERR("invalid format %s\n", fmt);
+        gs->data[gs->len] = '\0';
+        return s;
+    }
+    if ((uint32_t)len > gs->cap - gs->len) {
+        gs = __grrrs_reserve(gs, (uint32_t)len);
+        if (_VOID(gs->data)) { return NULL; }
+
+        va_start(args, fmt);
+        vsnprintf(gs->data + gs->len, gs->cap - gs->len + 1, fmt, args);
+        va_end(args);
+    }
+    gs->len += (uint32_t)len;
+
+    return gs->data;
+}
+
+/*
+ * Drops the contents of the string, keeping its capacity for reuse
+ */
+void grrrs_clear(char *s)
+{
+    if (_VOID(s)) { return; }
+
+    struct grrr_string *gs = _grrrs_ptr(s);
+    gs->len = 0;
+    gs->data[0] = '\0';
+}
+
 void *_grrrs_trim_left(char *s, const char *c)
 {
     char *result = s;
@@ -4,6 +4,7 @@
 #ifndef MPRIS_SCROBBLER_STRUCTS_H
 #define MPRIS_SCROBBLER_STRUCTS_H
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -58,6 +59,7 @@ enum api_type {
     api_librefm,
     api_listenbrainz,
 };
+#define API_TYPE_COUNT (api_listenbrainz + 1)
 
 #define MAX_SECRET_LENGTH 128
 struct api_credentials {
@@ -93,31 +95,56 @@ struct configuration {
     struct env_variables env;
     const char name[MAX_PROPERTY_LENGTH];
     const char pid_path[MAX_PROPERTY_LENGTH];
+    bool http2;
+    double rate_limit;
+    int rate_burst;
+    int debounce; // ms
     int ignore_players_count;
     const char ignore_players[MAX_PLAYERS][MAX_PROPERTY_LENGTH];
 };
 
 #define MAX_PROPERTY_COUNT 10
+#define MPRIS_STATUS_LENGTH 16
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t length;
+    size_t capacity;
+    char data[];
+};
+
+/*
+ * A chunked bump allocator, values can't be freed individually, only the whole arena can be reset
+ */
+struct arena {
+    struct arena_chunk *chunks;
+};
+
+/*
+ * The string values point either into the player's arena, or, while a signal is being
+ * handled, into the D-Bus message they were read from. Missing values are NULL.
+ */
 struct mpris_metadata {
     uint64_t length; // mpris specific
+    uint64_t fingerprint; // of the track, see track_fingerprint
     unsigned track_number;
     unsigned bitrate;
     unsigned disc_number;
-    char track_id[MAX_PROPERTY_LENGTH];
-    char album[MAX_PROPERTY_LENGTH];
-    char content_created[MAX_PROPERTY_LENGTH];
-    char title[MAX_PROPERTY_LENGTH];
-    char url[MAX_PROPERTY_LENGTH];
-    char art_url[MAX_PROPERTY_LENGTH]; //mpris specific
-    char composer[MAX_PROPERTY_LENGTH];
-    char genre[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
-    char comment[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
-    char artist[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
-    char album_artist[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
-    char mb_track_id[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH]; //music brainz specific
-    char mb_album_id[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
-    char mb_artist_id[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
-    char mb_album_artist_id[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
+    const char *track_id;
+    const char *album;
+    const char *content_created;
+    const char *title;
+    const char *url;
+    const char *art_url; //mpris specific
+    const char *composer;
+    const char *genre[MAX_PROPERTY_COUNT];
+    const char *comment[MAX_PROPERTY_COUNT];
+    const char *artist[MAX_PROPERTY_COUNT];
+    const char *album_artist[MAX_PROPERTY_COUNT];
+    const char *mb_track_id[MAX_PROPERTY_COUNT]; //music brainz specific
+    const char *mb_album_id[MAX_PROPERTY_COUNT];
+    const char *mb_artist_id[MAX_PROPERTY_COUNT];
+    const char *mb_album_artist_id[MAX_PROPERTY_COUNT];
 };
 
 struct mpris_properties {
@@ -130,10 +157,12 @@ struct mpris_properties {
     bool can_pause;
     bool can_seek;
     bool shuffle;
-    char player_name[MAX_PROPERTY_LENGTH];
-    char loop_status[MAX_PROPERTY_LENGTH];
-    char playback_status[MAX_PROPERTY_LENGTH];
+    char loop_status[MPRIS_STATUS_LENGTH];
+    char playback_status[MPRIS_STATUS_LENGTH];
     struct mpris_metadata metadata;
+    // holds the metadata strings, the spare one is used for building the next version on changes
+    struct arena strings;
+    struct arena spare;
 };
 
 struct events {
@@ -144,6 +173,27 @@ struct events {
     struct event dispatch;
 };
 
+enum scrobble_field {
+    scrobble_field_title = 0,
+    scrobble_field_album,
+    scrobble_field_spotify_id, // spotify id for listenbrainz
+    scrobble_field_artist,
+    scrobble_field_mb_track_id, //music brainz specific
+    scrobble_field_mb_album_id,
+    scrobble_field_mb_artist_id,
+    scrobble_field_mb_album_artist_id,
+    scrobble_field_count,
+};
+
+struct scrobble_field_range {
+    uint16_t offset; // position of the first value in the string pool
+    uint8_t count;   // number of values, stored one after the other, null terminated
+};
+
+/*
+ * A scrobble is a single allocation holding the numeric fields, an offset table
+ * and the pool of strings the table points into.
+ */
 struct scrobble {
     bool scrobbled;
     unsigned short track_number;
@@ -151,16 +201,14 @@ struct scrobble {
     time_t start_time;
     double play_time;
     double position;
-    char title[MAX_PROPERTY_LENGTH];
-    char album[MAX_PROPERTY_LENGTH];
-    char artist[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
+    uint64_t fingerprint; // of the track, 0 if unknown
 
-    char mb_track_id[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH]; //music brainz specific
-    char mb_album_id[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
-    char mb_artist_id[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
-    char mb_album_artist_id[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH];
+    uint64_t journal_id; // the id of the journal entry holding this scrobble, 0 if not journaled
+    unsigned journal_services; // mask of the services which already accepted this scrobble
 
-    char mb_spotify_id[MAX_PROPERTY_LENGTH]; // spotify id for listenbrainz
+    struct scrobble_field_range fields[scrobble_field_count];
+    uint16_t pool_length;
+    char pool[];
 };
 
 enum playback_state {
@@ -200,6 +248,8 @@ enum mpris_load_types {
     mpris_load_metadata_mb_album_id = 1U << 24U,
     mpris_load_metadata_mb_artist_id = 1U << 25U,
     mpris_load_metadata_mb_album_artist_id = 1U << 26U,
+    // the fields the track fingerprint is made of
+    mpris_load_track = mpris_load_metadata_length | mpris_load_metadata_album | mpris_load_metadata_artist | mpris_load_metadata_title | mpris_load_metadata_track_number,
     mpris_load_all = (1U << 31U) - 1, // all bits are set for our max enum val
 };
 
@@ -211,33 +261,123 @@ struct mpris_event {
     bool volume_changed;
     bool position_changed;
     unsigned loaded_state;
-    char sender_bus_id[MAX_PROPERTY_LENGTH];
+    const char *sender_bus_id; // borrowed from the signal message
 };
 
 struct dbus {
     DBusConnection *conn;
     DBusWatch *watch;
     DBusTimeout *timeout;
+    // the traffic from the bus, reported when closing
+    size_t wakeups;
+    size_t received;
+    size_t handled;
+    double filter_time; // seconds
+};
+
+struct dbus_timeout {
+    struct state *state;
+    DBusTimeout *timeout;
+    struct event event;
 };
 
 struct event_payload {
     // either the scrobbler or the player
     void *parent;
-    struct scrobble scrobble;
+    struct scrobble *scrobble;
     struct event event;
 };
 
-#define MAX_QUEUE_LENGTH 100
+struct scrobble_journal {
+    int fd;
+    bool dirty;
+    char *path;
+    uint64_t next_id;
+    size_t add_count;
+    size_t done_count;
+    // services whose acceptance is needed for an entry to be complete
+    unsigned required_services;
+    char *buffer;
+    struct event sync_event;
+    struct event compact_event;
+    struct {
+        bool running;
+        bool succeeded;
+        off_t snapshot_end;
+        unsigned required_services;
+        size_t add_count;
+        size_t done_count;
+        size_t kept;
+        pthread_t thread;
+    } compaction;
+};
+
+struct scrobble_queue {
+    struct scrobble **entries; // ring buffer holding the newest scrobbles
+    int capacity;
+    int head;
+    int length;
+    struct {
+        int fd;
+        char *path;
+        off_t read_offset;
+        size_t length;
+        char *buffer;
+    } spill;
+};
+
+enum breaker_state {
+    breaker_closed = 0,
+    breaker_open,
+    breaker_half_open,
+};
+
+/*
+ * The failed requests to a service, waiting for it to come back
+ */
+struct scrobbler_retry {
+    struct event event;
+    struct scrobbler *parent;
+    enum api_type end_point;
+    enum breaker_state state;
+    unsigned failures;
+    uint64_t *waiting; // connection handles
+};
+
+/*
+ * The token bucket limiting the requests sent to a service
+ */
+struct scrobbler_bucket {
+    struct event event;
+    struct scrobbler *parent;
+    enum api_type end_point;
+    double tokens;
+    double refilled_at;
+    uint64_t *waiting; // connection handles
+    size_t throttled;
+};
+
 struct scrobbler {
     int still_running;
+    bool http2;
+    double rate_limit;
+    int rate_burst;
     CURLM *handle;
+    CURLSH *share;
     struct api_credentials **credentials;
     struct event_base *evbase;
     struct event timer_event;
-    int queue_length;
-    struct scrobble queue[MAX_QUEUE_LENGTH];
+    struct scrobbler_retry retries[API_TYPE_COUNT];
+    struct scrobbler_bucket buckets[API_TYPE_COUNT];
+    uint64_t now_playing[API_TYPE_COUNT]; // handle of the latest now playing request for each service
+    CURL **idle_handles[API_TYPE_COUNT]; // easy handles of the finished requests, set up for reuse
+    struct scrobble_journal journal;
+    struct scrobble_queue queue;
+    uint64_t queued_fingerprint; // the latest track added to the queue
+    time_t queued_until; // when that track finishes playing
     int connections_length;
-    struct scrobbler_connection *connections[MAX_QUEUE_LENGTH+1];
+    int free_slot;
+    struct scrobbler_connection_slot *connection_slots;
 };
 
 struct mpris_player {
@@ -253,6 +393,29 @@ struct mpris_player {
     struct scrobbler *scrobbler;
     struct event_base *evbase;
     struct mpris_properties **history;
+    // the player is loaded when the replies to these calls arrive
+    DBusConnection *conn;
+    DBusPendingCall *identity_call;
+    DBusPendingCall *properties_call;
+    bool properties_matched; // its PropertiesChanged signals are routed to us
+    const struct configuration *config;
+    // the changes of a burst of signals are loaded together when it fires
+    struct event debounce;
+};
+
+struct player_index_slot {
+    const char *key; // the unique bus name or the well-known name of the player, NULL when free
+    uint32_t hash;
+    struct mpris_player *player;
+};
+
+/*
+ * Open addressing hash table, with linear probing, for finding the players by their names
+ */
+struct player_index {
+    struct player_index_slot *slots;
+    size_t capacity; // a power of two
+    size_t length;
 };
 
 struct state {
@@ -260,8 +423,8 @@ struct state {
     struct dbus *dbus;
     struct configuration *config;
     struct events events;
-    short player_count;
-    struct mpris_player players[MAX_PLAYERS];
+    struct mpris_player **players; // created when they show up on the bus
+    struct player_index player_names;
 };
 
 enum log_levels
@@ -295,19 +458,38 @@ struct parsed_arguments {
     char pid_path[MAX_PROPERTY_LENGTH + 1];
 };
 
-struct scrobbler_connection {
+/*
+ * The events for a socket curl uses, which with HTTP/2 can carry the transfers of more than one connection
+ */
+struct scrobbler_socket {
     struct event ev;
-    struct event retry_event;
+    curl_socket_t fd;
+    int action;
+};
+
+/*
+ * The connections are kept in a slot map: the free slots are chained in a list, and the
+ * generation of a slot changes every time it's freed, so a handle to a freed connection
+ * doesn't resolve to the one reusing its slot.
+ */
+struct scrobbler_connection_slot {
+    struct scrobbler_connection *conn;
+    uint32_t generation;
+    int next_free;
+};
+
+struct scrobbler_connection {
     struct api_credentials credentials;
     struct scrobbler *parent;
     CURL *handle;
     struct curl_slist **headers;
     struct http_request *request;
     struct http_response *response;
-    curl_socket_t sockfd;
-    int action;
+    bool now_playing;
     int idx;
+    uint32_t generation;
     int retries;
+    uint64_t *journal_ids;
     char error[CURL_ERROR_SIZE];
 };
 
@@ -26,6 +26,7 @@ enum log_levels _log_level;
 #define _is_zero(a) _eq(a, (char[sizeof(a)]){0})
 
 #define _to_bool(a) (a ? "yes" : "no")
+#define _str(a) (NULL == (a) ? "" : (a))
 
 #define array_count(a) (sizeof(a)/sizeof 0[a])
 #define max(a, b) (((a) >= (b)) ? a : b)
@@ -127,7 +128,7 @@ int _logd(enum log_levels level, const char *file, const char *function, const i
     return result;
 }
 
-void array_log_with_label(char *output, const char arr[MAX_PROPERTY_COUNT][MAX_PROPERTY_LENGTH], int len)
+void array_log_with_label(char *output, const char *const arr[MAX_PROPERTY_COUNT], int len)
 {
     if (len <= 0) { return; }
 
@@ -136,7 +137,7 @@ void array_log_with_label(char *output, const char arr[MAX_PROPERTY_COUNT][MAX_P
     char temp[MAX_PROPERTY_COUNT*MAX_PROPERTY_LENGTH+1] = {0};
     unsigned short cnt = 0;
     for (int i = 0; i < len; i++) {
-        if (strlen(arr[i]) == 0) {
+        if (NULL == arr[i] || strlen(arr[i]) == 0) {
             break;
         }
         if (i > 0) {
@@ -0,0 +1,131 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ *
+ * Sends rounds of concurrent now playing and scrobble requests to a single
+ * service, first over HTTP/2 and then over HTTP/1.1, and reports the
+ * requests per second and the sockets opened for each.
+ *
+ * The service is a local HTTPS server given in MPRIS_SCROBBLER_BENCH_URL,
+ * which needs to offer both h2 and http/1.1 over ALPN (eg, nghttpx in front of any
+ * HTTP server). As the server uses a self signed certificate, the peer is not verified.
+ *
+ * Sockets are counted by linking with --wrap for curl_multi_add_handle.
+ */
+
+#include <curl/curl.h>
+#include <dbus/dbus.h>
+#include <event.h>
+#include <time.h>
+#include "sstrings.h"
+#include "structs.h"
+#include "utils.h"
+#include "arena.h"
+#include "scrobble_record.h"
+#include "api.h"
+#include "smpris.h"
+#include "scrobbler.h"
+#include "scrobble.h"
+#include "sdbus.h"
+#include "sevents.h"
+#include "ini.h"
+#include "configuration.h"
+
+#define BENCH_ROUNDS            50
+#define BENCH_REQUESTS_PER_ROUND 20
+#define BENCH_URL_ENV           "MPRIS_SCROBBLER_BENCH_URL"
+#define BENCH_SKIP              77
+
+static size_t sockets_opened = 0;
+
+static curl_socket_t bench_open_socket(void *data, curlsocktype purpose, struct curl_sockaddr *address)
+{
+    (void)data;
+    (void)purpose;
+    curl_socket_t fd = socket(address->family, address->socktype, address->protocol);
+    if (CURL_SOCKET_BAD != fd) { sockets_opened++; }
+    return fd;
+}
+
+CURLMcode __real_curl_multi_add_handle(CURLM *, CURL *);
+CURLMcode __wrap_curl_multi_add_handle(CURLM *multi, CURL *handle)
+{
+    curl_easy_setopt(handle, CURLOPT_OPENSOCKETFUNCTION, bench_open_socket);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 0L);
+    return __real_curl_multi_add_handle(multi, handle);
+}
+
+static int bench_run(struct configuration *config, struct event_base *base, const struct scrobble *tracks[], bool http2)
+{
+    static struct scrobbler s = {0};
+    memset(&s, 0, sizeof(s));
+    config->http2 = http2;
+    scrobbler_init(&s, config, base);
+    sockets_opened = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        // a track change: a scrobble for the previous track and now playing updates for the new one
+        api_request_do(&s, tracks, 1, api_build_request_scrobble);
+        for (int j = 1; j < BENCH_REQUESTS_PER_ROUND; j++) {
+            api_request_do(&s, tracks, 1, api_build_request_now_playing);
+        }
+        while (s.connections_length > 0) {
+            event_base_loop(base, EVLOOP_ONCE);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    int requests = BENCH_ROUNDS * BENCH_REQUESTS_PER_ROUND;
+    fprintf(stdout, "%s:\n", http2 ? "HTTP/2" : "HTTP/1.1");
+    fprintf(stdout, "  requests:       %d\n", requests);
+    fprintf(stdout, "  requests/s:     %.0f\n", requests / elapsed);
+    fprintf(stdout, "  sockets:        %zu\n", sockets_opened);
+
+    scrobbler_clean(&s);
+    return sockets_opened > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(void)
+{
+    const char *url = getenv(BENCH_URL_ENV);
+    if (NULL == url || strlen(url) == 0) {
+        fprintf(stderr, "%s is not set, skipping\n", BENCH_URL_ENV);
+        return BENCH_SKIP;
+    }
+    _log_level = log_warning;
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    struct event_base *base = event_base_new();
+    static struct configuration config = {0};
+    struct api_credentials credentials = {
+        .end_point = api_lastfm,
+        .enabled = true,
+        .url = url,
+        .api_key = "0123456789abcdef0123456789abcdef",
+        .secret = "fedcba9876543210fedcba9876543210",
+    };
+    strncpy((char*)credentials.session_key, "bench", MAX_SECRET_LENGTH);
+    arrput(config.credentials, &credentials);
+
+    struct scrobble_values values = {0};
+    values.values[scrobble_field_title][0] = "Some Track Title";
+    values.values[scrobble_field_album][0] = "Some Album Name";
+    values.values[scrobble_field_artist][0] = "Some Artist";
+    struct scrobble *track = scrobble_pack(&values);
+    assert(NULL != track);
+    const struct scrobble *tracks[1] = {track};
+
+    int status = bench_run(&config, base, tracks, true);
+    if (EXIT_SUCCESS == status) {
+        status = bench_run(&config, base, tracks, false);
+    }
+
+    scrobble_free(track);
+    arrfree(config.credentials);
+    event_base_free(base);
+    curl_global_cleanup();
+    return status;
+}
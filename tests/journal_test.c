@@ -0,0 +1,288 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+
+#include <curl/curl.h>
+#include <dbus/dbus.h>
+#include <event.h>
+#include <event2/thread.h>
+#include <time.h>
+#include "sstrings.h"
+#include "structs.h"
+#include "utils.h"
+#include "arena.h"
+#include "scrobble_record.h"
+#include "api.h"
+#include "smpris.h"
+#include "scrobbler.h"
+#include "scrobble.h"
+#include "sdbus.h"
+#include "sevents.h"
+#include "ini.h"
+#include "configuration.h"
+
+#include <snow/snow.h>
+
+#define TEST_SERVICE_A      1U
+#define TEST_SERVICE_B      2U
+#define TEST_SERVICES       (TEST_SERVICE_A | TEST_SERVICE_B)
+
+static char test_dir[] = "/tmp/mpris-scrobbler-journal-XXXXXX";
+static char test_path[sizeof(test_dir) + 16];
+
+static struct scrobble *test_scrobble(int number)
+{
+    char title[32] = {0};
+    snprintf(title, sizeof(title), "Track %d", number);
+
+    struct scrobble_values values = {0};
+    values.values[scrobble_field_title][0] = title;
+    values.values[scrobble_field_album][0] = "Album";
+    values.values[scrobble_field_artist][0] = "Artist";
+    struct scrobble *track = scrobble_pack(&values);
+    track->length = 180 + number;
+    return track;
+}
+
+static uint64_t test_add(struct scrobble_journal *j, int number)
+{
+    struct scrobble *track = test_scrobble(number);
+    uint64_t id = journal_add(j, track);
+    scrobble_free(track);
+    return id;
+}
+
+static void test_open(struct scrobble_journal *j, struct scrobble_queue *q, struct event_base *base, unsigned services)
+{
+    memset(j, 0, sizeof(*j));
+    memset(q, 0, sizeof(*q));
+    scrobble_queue_init(q, NULL);
+    j->required_services = services;
+    journal_open(j, test_path, base, q);
+}
+
+static void test_close(struct scrobble_journal *j, struct scrobble_queue *q)
+{
+    journal_close(j);
+    scrobble_queue_free(q);
+}
+
+static off_t test_file_size(void)
+{
+    struct stat st = {0};
+    stat(test_path, &st);
+    return st.st_size;
+}
+
+static void test_free_loaded(struct scrobble **loaded)
+{
+    for (int i = 0; i < arrlen(loaded); i++) {
+        scrobble_free(loaded[i]);
+    }
+    arrfree(loaded);
+}
+
+describe(journal) {
+    assertneq(mkdtemp(test_dir), NULL);
+    snprintf(test_path, sizeof(test_path), "%s/journal", test_dir);
+
+    subdesc(records) {
+        it ("Keeps the entries not done for all the services across reopens") {
+            struct scrobble_journal j;
+            struct scrobble_queue q;
+            test_open(&j, &q, NULL, TEST_SERVICES);
+            assert(j.fd >= 0);
+            asserteq_int(scrobble_queue_length(&q), 0);
+
+            uint64_t first = test_add(&j, 1);
+            uint64_t second = test_add(&j, 2);
+            uint64_t third = test_add(&j, 3);
+            asserteq_int(first, 1);
+            asserteq_int(third, 3);
+
+            journal_mark_done(&j, &first, 1, TEST_SERVICE_A);
+            journal_mark_done(&j, &second, 1, TEST_SERVICES);
+            test_close(&j, &q);
+
+            test_open(&j, &q, NULL, TEST_SERVICES);
+            asserteq_int(scrobble_queue_length(&q), 2);
+            struct scrobble *track = scrobble_queue_at(&q, 0);
+            asserteq_int(track->journal_id, first);
+            asserteq_int(track->journal_services, TEST_SERVICE_A);
+            asserteq_str(scrobble_title(track), "Track 1");
+            asserteq_int(track->length, 181);
+            track = scrobble_queue_at(&q, 1);
+            asserteq_int(track->journal_id, third);
+            asserteq_int(track->journal_services, 0);
+            asserteq_str(scrobble_artist(track, 0), "Artist");
+
+            // the ids keep increasing after a reopen
+            asserteq_int(test_add(&j, 4), 4);
+            journal_discard(&j, third);
+            test_close(&j, &q);
+
+            test_open(&j, &q, NULL, TEST_SERVICES);
+            asserteq_int(scrobble_queue_length(&q), 2);
+            asserteq_int(scrobble_queue_at(&q, 0)->journal_id, first);
+            asserteq_int(scrobble_queue_at(&q, 1)->journal_id, 4);
+            test_close(&j, &q);
+            unlink(test_path);
+        }
+
+        it ("Truncates a torn tail, and appends after it") {
+            struct scrobble_journal j;
+            struct scrobble_queue q;
+            test_open(&j, &q, NULL, TEST_SERVICES);
+            test_add(&j, 1);
+            off_t valid_size = test_file_size();
+            test_add(&j, 2);
+            test_close(&j, &q);
+
+            // a crash in the middle of writing the last record
+            assert(truncate(test_path, test_file_size() - 5) == 0);
+
+            test_open(&j, &q, NULL, TEST_SERVICES);
+            asserteq_int(scrobble_queue_length(&q), 1);
+            asserteq_str(scrobble_title(scrobble_queue_at(&q, 0)), "Track 1");
+            asserteq_int(test_file_size(), valid_size);
+            asserteq_int(test_add(&j, 3), 2);
+            test_close(&j, &q);
+
+            test_open(&j, &q, NULL, TEST_SERVICES);
+            asserteq_int(scrobble_queue_length(&q), 2);
+            asserteq_str(scrobble_title(scrobble_queue_at(&q, 1)), "Track 3");
+            test_close(&j, &q);
+            unlink(test_path);
+        }
+
+        it ("Drops a record with a bad checksum, and everything after it") {
+            struct scrobble_journal j;
+            struct scrobble_queue q;
+            test_open(&j, &q, NULL, TEST_SERVICES);
+            test_add(&j, 1);
+            off_t valid_size = test_file_size();
+            test_add(&j, 2);
+            test_add(&j, 3);
+            test_close(&j, &q);
+
+            int fd = open(test_path, O_RDWR);
+            char byte = 0;
+            off_t offset = valid_size + sizeof(struct journal_record) + 1;
+            assert(pread(fd, &byte, 1, offset) == 1);
+            byte ^= 0x5a;
+            assert(pwrite(fd, &byte, 1, offset) == 1);
+            close(fd);
+
+            test_open(&j, &q, NULL, TEST_SERVICES);
+            asserteq_int(scrobble_queue_length(&q), 1);
+            asserteq_int(test_file_size(), valid_size);
+            test_close(&j, &q);
+            unlink(test_path);
+        }
+
+        it ("Discards a journal with an unknown header") {
+            int fd = open(test_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+            struct journal_header header = { .magic = "MPSJ", .version = JOURNAL_VERSION + 1, };
+            assert(write(fd, &header, sizeof(header)) == sizeof(header));
+            assert(write(fd, "junk", 4) == 4);
+            close(fd);
+
+            struct scrobble_journal j;
+            struct scrobble_queue q;
+            test_open(&j, &q, NULL, TEST_SERVICES);
+            assert(j.fd >= 0);
+            asserteq_int(scrobble_queue_length(&q), 0);
+            asserteq_int(test_file_size(), sizeof(struct journal_header));
+            test_close(&j, &q);
+            unlink(test_path);
+        }
+    }
+
+    subdesc(done records) {
+        it ("Finds the entries of the done records among many") {
+            struct scrobble_journal j;
+            struct scrobble_queue q;
+            test_open(&j, &q, NULL, TEST_SERVICE_A);
+            uint64_t ids[100] = {0};
+            for (int i = 0; i < 100; i++) {
+                ids[i] = test_add(&j, i);
+            }
+            // done in a different order than added: every odd one, from the last
+            for (int i = 99; i >= 0; i -= 2) {
+                journal_mark_done(&j, &ids[i], 1, TEST_SERVICE_A);
+            }
+            // and one which isn't in the journal
+            uint64_t missing = 1000;
+            journal_mark_done(&j, &missing, 1, TEST_SERVICE_A);
+            test_close(&j, &q);
+
+            test_open(&j, &q, NULL, TEST_SERVICE_A);
+            asserteq_int(scrobble_queue_length(&q), 50);
+            for (int i = 0; i < 50; i++) {
+                asserteq_int(scrobble_queue_at(&q, i)->journal_id, ids[i * 2]);
+            }
+            asserteq_int(j.done_count, 51);
+            test_close(&j, &q);
+            unlink(test_path);
+        }
+    }
+
+    subdesc(compaction) {
+        it ("Keeps the records appended while compacting, and the journal readable after") {
+            evthread_use_pthreads();
+            struct event_base *base = event_base_new();
+            struct scrobble_journal j;
+            struct scrobble_queue q;
+            test_open(&j, &q, base, TEST_SERVICE_A);
+
+            int number = 0;
+            for (int round = 0; round < 2; round++) {
+                uint64_t ids[300] = {0};
+                for (int i = 0; i < 300; i++) {
+                    ids[i] = test_add(&j, number++);
+                }
+                // the first 290 of each round are accepted
+                journal_mark_done(&j, ids, 290, TEST_SERVICE_A);
+
+                journal_maybe_compact(&j);
+                assert(j.compaction.running);
+                // written to the old journal while the thread copies the snapshot
+                test_add(&j, number++);
+                test_add(&j, number++);
+                journal_compact_finish(&j);
+                event_base_loop(base, EVLOOP_NONBLOCK);
+
+                assert(j.fd >= 0);
+                asserteq_int(j.add_count, round == 0 ? 12 : 25);
+                asserteq_int(j.done_count, 0);
+                // written to the compacted one
+                test_add(&j, number++);
+
+                struct scrobble **pending = journal_load_pending(&j, TEST_SERVICE_A, NULL, 0);
+                asserteq_int(arrlen(pending), (round + 1) * 13);
+                asserteq_str(scrobble_title(pending[arrlen(pending) - 1]), round == 0 ? "Track 302" : "Track 605");
+                test_free_loaded(pending);
+            }
+
+            // the ids held elsewhere are left out
+            uint64_t exclude[2] = {291, 292};
+            struct scrobble **pending = journal_load_pending(&j, TEST_SERVICE_A, exclude, 2);
+            asserteq_int(arrlen(pending), 24);
+            asserteq_int(pending[0]->journal_id, 293);
+            asserteq_int(pending[0]->journal_services, JOURNAL_SERVICES_ALL & ~TEST_SERVICE_A);
+            test_free_loaded(pending);
+            test_close(&j, &q);
+
+            test_open(&j, &q, NULL, TEST_SERVICE_A);
+            asserteq_int(scrobble_queue_length(&q), 26);
+            asserteq_int(j.next_id, 607);
+            test_close(&j, &q);
+            unlink(test_path);
+            event_base_free(base);
+        }
+    }
+
+    rmdir(test_dir);
+};
+
+snow_main();
@@ -0,0 +1,143 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+
+#include <curl/curl.h>
+#include <dbus/dbus.h>
+#include <event.h>
+#include <time.h>
+#include "sstrings.h"
+#include "structs.h"
+#include "utils.h"
+#include "arena.h"
+#include "scrobble_record.h"
+#include "api.h"
+#include "smpris.h"
+#include "scrobbler.h"
+#include "scrobble.h"
+#include "sdbus.h"
+#include "sevents.h"
+#include "ini.h"
+#include "configuration.h"
+
+#include <snow/snow.h>
+
+#define TEST_PLAYERS    300
+#define TEST_STEPS      200000
+
+static struct mpris_player *test_player(const char *bus_id, const char *mpris_name)
+{
+    struct mpris_player *player = calloc(1, sizeof(struct mpris_player));
+    strncpy(player->bus_id, bus_id, MAX_PROPERTY_LENGTH);
+    strncpy(player->mpris_name, mpris_name, MAX_PROPERTY_LENGTH);
+    return player;
+}
+
+describe(player_index) {
+    subdesc(keys) {
+        it ("Finds a player by both its names") {
+            struct player_index index = {0};
+            struct mpris_player *player = test_player(":1.42", "org.mpris.MediaPlayer2.spotify");
+
+            asserteq_ptr(player_index_find(&index, ":1.42"), NULL);
+            player_index_add(&index, player);
+            asserteq_int(index.length, 2);
+            asserteq_ptr(player_index_find(&index, ":1.42"), player);
+            asserteq_ptr(player_index_find(&index, "org.mpris.MediaPlayer2.spotify"), player);
+            asserteq_ptr(player_index_find(&index, ":1.43"), NULL);
+            asserteq_ptr(player_index_find(&index, NULL), NULL);
+
+            player_index_clean(&index);
+            free(player);
+        }
+
+        it ("Removes a player, and adds it back") {
+            struct player_index index = {0};
+            struct mpris_player *player = test_player(":1.42", "org.mpris.MediaPlayer2.spotify");
+
+            player_index_add(&index, player);
+            player_index_remove(&index, player);
+            asserteq_int(index.length, 0);
+            asserteq_ptr(player_index_find(&index, ":1.42"), NULL);
+            asserteq_ptr(player_index_find(&index, "org.mpris.MediaPlayer2.spotify"), NULL);
+
+            player_index_add(&index, player);
+            asserteq_int(index.length, 2);
+            asserteq_ptr(player_index_find(&index, ":1.42"), player);
+            // removing it twice doesn't change anything
+            player_index_remove(&index, player);
+            player_index_remove(&index, player);
+            asserteq_int(index.length, 0);
+
+            player_index_clean(&index);
+            free(player);
+        }
+
+        it ("Keeps the well-known name with the player which took it over") {
+            struct player_index index = {0};
+            struct mpris_player *previous = test_player(":1.42", "org.mpris.MediaPlayer2.vlc");
+            struct mpris_player *current = test_player(":1.43", "org.mpris.MediaPlayer2.vlc");
+
+            player_index_add(&index, previous);
+            player_index_add(&index, current);
+            asserteq_int(index.length, 3);
+            asserteq_ptr(player_index_find(&index, "org.mpris.MediaPlayer2.vlc"), current);
+
+            // the previous owner going away leaves the name to the new one
+            player_index_remove(&index, previous);
+            asserteq_int(index.length, 2);
+            asserteq_ptr(player_index_find(&index, ":1.42"), NULL);
+            asserteq_ptr(player_index_find(&index, ":1.43"), current);
+            asserteq_ptr(player_index_find(&index, "org.mpris.MediaPlayer2.vlc"), current);
+
+            player_index_clean(&index);
+            free(previous);
+            free(current);
+        }
+    }
+
+    subdesc(probing) {
+        it ("Matches a reference through random adds and removes") {
+            struct player_index index = {0};
+            struct mpris_player *players[TEST_PLAYERS] = {0};
+            bool added[TEST_PLAYERS] = {0};
+            for (int i = 0; i < TEST_PLAYERS; i++) {
+                char bus_id[32] = {0};
+                char mpris_name[64] = {0};
+                snprintf(bus_id, sizeof(bus_id), ":1.%d", i);
+                snprintf(mpris_name, sizeof(mpris_name), "org.mpris.MediaPlayer2.player%d", i);
+                players[i] = test_player(bus_id, mpris_name);
+            }
+
+            // removing from a crowded table moves the following keys back, across the wrap around too
+            srand(1);
+            for (int step = 0; step < TEST_STEPS; step++) {
+                int i = rand() % TEST_PLAYERS;
+                if (added[i]) {
+                    player_index_remove(&index, players[i]);
+                } else {
+                    player_index_add(&index, players[i]);
+                }
+                added[i] = !added[i];
+                if (step % 97 != 0) { continue; }
+
+                size_t length = 0;
+                for (int k = 0; k < TEST_PLAYERS; k++) {
+                    struct mpris_player *expected = added[k] ? players[k] : NULL;
+                    asserteq_ptr(player_index_find(&index, players[k]->bus_id), expected);
+                    asserteq_ptr(player_index_find(&index, players[k]->mpris_name), expected);
+                    length += added[k] ? 2 : 0;
+                }
+                asserteq_int(index.length, length);
+                assert(index.length * 2 <= index.capacity);
+            }
+
+            player_index_clean(&index);
+            for (int i = 0; i < TEST_PLAYERS; i++) {
+                free(players[i]);
+            }
+        }
+    }
+};
+
+snow_main();
@@ -0,0 +1,127 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ */
+
+#include <curl/curl.h>
+#include <dbus/dbus.h>
+#include <event.h>
+#include <time.h>
+#include "sstrings.h"
+#include "structs.h"
+#include "utils.h"
+#include "arena.h"
+#include "scrobble_record.h"
+#include "api.h"
+#include "smpris.h"
+#include "scrobbler.h"
+#include "scrobble.h"
+#include "sdbus.h"
+#include "sevents.h"
+#include "ini.h"
+#include "configuration.h"
+
+#include <snow/snow.h>
+
+#define TEST_SAMPLES    1000
+
+/* Loads the header line the way curl hands it over */
+static struct http_response *test_response(const char *header)
+{
+    struct http_response *res = http_response_new();
+    if (NULL != header) {
+        http_response_write_headers((char*)header, 1, strlen(header), res);
+    }
+    return res;
+}
+
+static long test_retry_after(const char *header)
+{
+    struct http_response *res = test_response(header);
+    long result = http_response_retry_after(res);
+    http_response_free(res);
+    return result;
+}
+
+static long test_retry_after_date(time_t date)
+{
+    char header[128] = {0};
+    size_t len = strftime(header, sizeof(header), RETRY_AFTER_HEADER_NAME ": %a, %d %b %Y %H:%M:%S GMT\r\n", gmtime(&date));
+    assert(len > 0);
+    return test_retry_after(header);
+}
+
+describe(retry) {
+    subdesc(retry_after) {
+        it ("Is missing without the header") {
+            asserteq_int(test_retry_after(NULL), -1);
+            asserteq_int(test_retry_after("Content-Type: application/json\r\n"), -1);
+        }
+
+        it ("Reads a delay in seconds") {
+            asserteq_int(test_retry_after("Retry-After: 120\r\n"), 120);
+            asserteq_int(test_retry_after("Retry-After: 0\r\n"), 0);
+            // HTTP/2 sends the names in lower case
+            asserteq_int(test_retry_after("retry-after: 30\r\n"), 30);
+        }
+
+        it ("Doesn't go back in time") {
+            asserteq_int(test_retry_after("Retry-After: -5\r\n"), 0);
+            asserteq_int(test_retry_after_date(time(NULL) - 3600), 0);
+        }
+
+        it ("Reads an HTTP date") {
+            long seconds = test_retry_after_date(time(NULL) + 60);
+            assert(seconds >= 58 && seconds <= 60);
+        }
+
+        it ("Ignores junk") {
+            asserteq_int(test_retry_after("Retry-After: soon\r\n"), -1);
+            asserteq_int(test_retry_after("Retry-After: Someday, 99 Never 20xx\r\n"), -1);
+        }
+    }
+
+    subdesc(backoff) {
+        it ("Waits between half and all of the doubled delay") {
+            for (unsigned failures = 0; failures < 6; failures++) {
+                double delay = RETRY_BASE_SECONDS * (double)(1U << failures);
+                for (int i = 0; i < TEST_SAMPLES; i++) {
+                    struct timeval timeout = retry_backoff(failures);
+                    double wait = timeval_to_seconds(timeout);
+                    assert(wait >= delay / 2 && wait <= delay);
+                }
+            }
+        }
+
+        it ("Is capped") {
+            for (unsigned failures = 9; failures < 64; failures += 7) {
+                struct timeval wait = retry_backoff(failures);
+                assert(wait.tv_sec >= RETRY_MAX_SECONDS / 2 && wait.tv_sec <= RETRY_MAX_SECONDS);
+            }
+        }
+
+        it ("Caps the delay the service asks for") {
+            struct event_base *base = event_base_new();
+            static struct scrobbler s = {0};
+            s.evbase = base;
+            struct scrobbler_retry *r = &s.retries[api_listenbrainz];
+            retry_init(r, &s, api_listenbrainz);
+
+            // a request waiting for the service
+            arrput(r->waiting, 1);
+            retry_schedule(r, 365 * 24 * 3600);
+
+            struct timeval now, pending;
+            event_base_gettimeofday_cached(base, &now);
+            assert(evtimer_pending(&r->event, &pending));
+            double from = timeval_to_seconds(now);
+            double until = timeval_to_seconds(pending);
+            double wait = until - from;
+            assert(wait > RETRY_MAX_SECONDS - 5 && wait <= RETRY_MAX_SECONDS + 1);
+
+            retry_clean(r);
+            event_base_free(base);
+        }
+    }
+};
+
+snow_main();
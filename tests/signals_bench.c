@@ -0,0 +1,240 @@
+/**
+ * @author Marius Orcsik <marius@habarnam.ro>
+ *
+ * Replays PropertiesChanged signals through the D-Bus filter of the daemon
+ * and reports the time and the bytes copied for each one.
+ *
+ * Copies are counted by linking with --wrap for memcpy, memmove and memset
+ * and building with -fno-builtin, so only calls made from the daemon code count.
+ */
+
+#include <curl/curl.h>
+#include <dbus/dbus.h>
+#include <event.h>
+#include <time.h>
+#include "sstrings.h"
+#include "structs.h"
+#include "utils.h"
+#include "arena.h"
+#include "scrobble_record.h"
+#include "api.h"
+#include "smpris.h"
+#include "scrobbler.h"
+#include "scrobble.h"
+#include "sdbus.h"
+#include "sevents.h"
+#include "ini.h"
+#include "configuration.h"
+
+#define BENCH_SIGNALS           100000
+#define BENCH_TRACKS            200
+#define BENCH_SIGNALS_PER_TRACK 500
+#define BENCH_POSITIONS         60
+#define BENCH_BUS_ID            ":1.42"
+
+void *__real_memcpy(void *, const void *, size_t);
+void *__real_memmove(void *, const void *, size_t);
+void *__real_memset(void *, int, size_t);
+
+static bool counting = false;
+static size_t bytes_copied = 0;
+static size_t bytes_zeroed = 0;
+
+void *__wrap_memcpy(void *dest, const void *src, size_t n)
+{
+    if (counting) { bytes_copied += n; }
+    return __real_memcpy(dest, src, n);
+}
+
+void *__wrap_memmove(void *dest, const void *src, size_t n)
+{
+    if (counting) { bytes_copied += n; }
+    return __real_memmove(dest, src, n);
+}
+
+void *__wrap_memset(void *dest, int c, size_t n)
+{
+    if (counting) { bytes_zeroed += n; }
+    return __real_memset(dest, c, n);
+}
+
+static void append_variant(DBusMessageIter *dict, const char *key, int type, const char *signature, const void *value)
+{
+    DBusMessageIter entry, variant;
+    dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, signature, &variant);
+    dbus_message_iter_append_basic(&variant, type, value);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(dict, &entry);
+}
+
+static void append_string_array(DBusMessageIter *dict, const char *key, const char *value)
+{
+    DBusMessageIter entry, variant, array;
+    dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "as", &variant);
+    dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "s", &array);
+    dbus_message_iter_append_basic(&array, DBUS_TYPE_STRING, &value);
+    dbus_message_iter_close_container(&variant, &array);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(dict, &entry);
+}
+
+static void append_metadata(DBusMessageIter *dict, int track)
+{
+    DBusMessageIter entry, variant, metadata;
+    const char *key = MPRIS_PNAME_METADATA;
+    dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "a{sv}", &variant);
+    dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "{sv}", &metadata);
+
+    char title[MAX_PROPERTY_LENGTH] = {0};
+    char track_id[MAX_PROPERTY_LENGTH] = {0};
+    snprintf(title, sizeof(title), "Some Track Title %d", track);
+    snprintf(track_id, sizeof(track_id), "/org/mpris/MediaPlayer2/Track/%d", track);
+    const char *title_ptr = title;
+    const char *track_id_ptr = track_id;
+    const char *album = "Some Album Name";
+    const char *url = "file:///home/user/Music/Some Artist/Some Album Name/track.flac";
+    const char *art_url = "file:///tmp/cover.jpg";
+    int64_t length = 215000000;
+    int32_t track_number = track % 12 + 1;
+
+    append_variant(&metadata, MPRIS_METADATA_TRACKID, DBUS_TYPE_OBJECT_PATH, "o", &track_id_ptr);
+    append_variant(&metadata, MPRIS_METADATA_LENGTH, DBUS_TYPE_INT64, "x", &length);
+    append_variant(&metadata, MPRIS_METADATA_TITLE, DBUS_TYPE_STRING, "s", &title_ptr);
+    append_variant(&metadata, MPRIS_METADATA_ALBUM, DBUS_TYPE_STRING, "s", &album);
+    append_variant(&metadata, MPRIS_METADATA_URL, DBUS_TYPE_STRING, "s", &url);
+    append_variant(&metadata, MPRIS_METADATA_ART_URL, DBUS_TYPE_STRING, "s", &art_url);
+    append_variant(&metadata, MPRIS_METADATA_TRACK_NUMBER, DBUS_TYPE_INT32, "i", &track_number);
+    append_string_array(&metadata, MPRIS_METADATA_ARTIST, "Some Artist");
+    append_string_array(&metadata, MPRIS_METADATA_ALBUM_ARTIST, "Some Artist");
+    append_string_array(&metadata, MPRIS_METADATA_GENRE, "Rock");
+    append_string_array(&metadata, MPRIS_METADATA_MUSICBRAINZ_TRACK_ID, "0383dadf-2a4e-4d10-a46a-e9e041da8eb3");
+    append_string_array(&metadata, MPRIS_METADATA_MUSICBRAINZ_ARTIST_ID, "8e66ea2b-b57b-47d9-8df0-df4630aeb8e5");
+
+    dbus_message_iter_close_container(&variant, &metadata);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(dict, &entry);
+}
+
+/*
+ * Builds a PropertiesChanged signal with either the playback status and the full metadata,
+ * or only the position, as players send them.
+ */
+static DBusMessage *signal_new(bool with_metadata, int track)
+{
+    DBusMessage *msg = dbus_message_new_signal(MPRIS_PLAYER_PATH, DBUS_INTERFACE_PROPERTIES, DBUS_SIGNAL_PROPERTIES_CHANGED);
+    assert(NULL != msg);
+    dbus_message_set_sender(msg, BENCH_BUS_ID);
+
+    DBusMessageIter args, changed, invalidated;
+    const char *interface = MPRIS_PLAYER_INTERFACE;
+    dbus_message_iter_init_append(msg, &args);
+    dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &interface);
+    dbus_message_iter_open_container(&args, DBUS_TYPE_ARRAY, "{sv}", &changed);
+    if (with_metadata) {
+        const char *status = MPRIS_PLAYBACK_STATUS_PLAYING;
+        append_variant(&changed, MPRIS_PNAME_PLAYBACKSTATUS, DBUS_TYPE_STRING, "s", &status);
+        append_metadata(&changed, track);
+    } else {
+        int64_t position = 1000000 * (int64_t)track;
+        append_variant(&changed, MPRIS_PNAME_POSITION, DBUS_TYPE_INT64, "x", &position);
+    }
+    dbus_message_iter_close_container(&args, &changed);
+    dbus_message_iter_open_container(&args, DBUS_TYPE_ARRAY, "s", &invalidated);
+    dbus_message_iter_close_container(&args, &invalidated);
+
+    return msg;
+}
+
+int main(void)
+{
+    static struct state s = {0};
+    static struct configuration config = {0};
+    static struct dbus dbus = {0};
+    _log_level = log_warning;
+
+    s.config = &config;
+    s.dbus = &dbus;
+    s.events.base = event_base_new();
+    s.scrobbler.evbase = s.events.base;
+    scrobble_queue_init(&s.scrobbler.queue, NULL);
+
+    struct mpris_player *player = mpris_player_new();
+    assert(NULL != player);
+    strncpy(player->mpris_name, MPRIS_PLAYER_NAMESPACE ".bench", MAX_PROPERTY_LENGTH);
+    strncpy(player->bus_id, BENCH_BUS_ID, MAX_PROPERTY_LENGTH);
+    strncpy(player->name, "bench", MAX_PROPERTY_LENGTH);
+    player->scrobbler = &s.scrobbler;
+    player->evbase = s.events.base;
+    player->now_playing.parent = player;
+    player->queue.parent = player;
+    // every signal is handled as it comes, without waiting for the debounce window
+    player->config = &config;
+    arrput(s.players, player);
+    player_index_add(&s.player_names, player);
+
+    // every track starts with its metadata, then gets position updates
+    // and, every fifth signal, the same metadata again, like browsers and spotify do
+    DBusMessage *tracks[BENCH_TRACKS] = {0};
+    DBusMessage *resends[BENCH_TRACKS] = {0};
+    DBusMessage *positions[BENCH_POSITIONS] = {0};
+    for (int i = 0; i < BENCH_TRACKS; i++) {
+        tracks[i] = signal_new(true, i);
+        resends[i] = signal_new(true, i);
+    }
+    for (int i = 0; i < BENCH_POSITIONS; i++) {
+        positions[i] = signal_new(false, i);
+    }
+
+    // the connection is only checked for NULL on this path
+    DBusConnection *conn = (DBusConnection*)&s;
+    player->conn = conn;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    counting = true;
+    for (int i = 0; i < BENCH_SIGNALS; i++) {
+        int track = (i / BENCH_SIGNALS_PER_TRACK) % BENCH_TRACKS;
+        DBusMessage *msg = positions[i % BENCH_POSITIONS];
+        if (i % BENCH_SIGNALS_PER_TRACK == 0) {
+            msg = tracks[track];
+        } else if (i % 5 == 0) {
+            msg = resends[track];
+        }
+        add_filter(conn, msg, &s);
+    }
+    counting = false;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    fprintf(stdout, "signals:          %d\n", BENCH_SIGNALS);
+    fprintf(stdout, "time/signal:      %.0f ns\n", elapsed / BENCH_SIGNALS);
+    fprintf(stdout, "signals/s:        %.0f\n", BENCH_SIGNALS / (elapsed / 1e9));
+    fprintf(stdout, "copied/signal:    %zu bytes\n", bytes_copied / BENCH_SIGNALS);
+    fprintf(stdout, "zeroed/signal:    %zu bytes\n", bytes_zeroed / BENCH_SIGNALS);
+
+    int status = EXIT_SUCCESS;
+    if (!mpris_string_equals(player->properties.metadata.title, "Some Track Title 199")) {
+        fprintf(stderr, "unexpected title: %s\n", _str(player->properties.metadata.title));
+        status = EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < BENCH_TRACKS; i++) {
+        dbus_message_unref(tracks[i]);
+        dbus_message_unref(resends[i]);
+    }
+    for (int i = 0; i < BENCH_POSITIONS; i++) {
+        dbus_message_unref(positions[i]);
+    }
+    player_index_clean(&s.player_names);
+    mpris_player_free(player);
+    arrfree(s.players);
+    scrobble_queue_free(&s.scrobbler.queue);
+    event_base_free(s.events.base);
+    return status;
+}
@@ -133,6 +133,75 @@ describe(basic) {
         }
     }
 
+    subdesc(append) {
+        it("Append to empty string") {
+            char *t = grrrs_from_string(0);
+
+            t = grrrs_append(t, "ana", 3);
+            defer(_grrrs_free(t));
+
+            asserteq_buf(t, "ana", 4);
+            asserteq_int(grrrs_len(t), 3);
+            asserteq_int(grrrs_cap(t), GRRRS_MIN_CAPACITY);
+        }
+        it("Append NULL or empty value") {
+            char *t = grrrs_from_string("ana");
+
+            t = grrrs_append(t, NULL, 3);
+            t = grrrs_append_cstring(t, "");
+            defer(_grrrs_free(t));
+
+            asserteq_buf(t, "ana", 4);
+            asserteq_int(grrrs_len(t), 3);
+            asserteq_int(grrrs_cap(t), 3);
+        }
+        it("Append past the capacity doubles it") {
+            char *t = grrrs_from_string(0);
+
+            for (int i = 0; i < 100; i++) {
+                t = grrrs_append(t, "0123456789", 10);
+            }
+            defer(_grrrs_free(t));
+
+            asserteq_int(grrrs_len(t), 1000);
+            asserteq_int(grrrs_cap(t), 1024);
+            asserteq_int(strlen(t), 1000);
+            asserteq_buf(t + 990, "0123456789", 11);
+        }
+        it("Append formatted values") {
+            char *t = grrrs_from_string("album");
+
+            t = grrrs_append_format(t, "[%d]=%s&", 12, "mere");
+            defer(_grrrs_free(t));
+
+            asserteq_buf(t, "album[12]=mere&", 16);
+            asserteq_int(grrrs_len(t), 15);
+        }
+        it("Append formatted values larger than the capacity") {
+            char *t = grrrs_from_string(0);
+            char value[200] = {0};
+            memset(value, 'a', 199);
+
+            t = grrrs_append_format(t, "%s|%s", value, value);
+            defer(_grrrs_free(t));
+
+            asserteq_int(grrrs_len(t), 399);
+            asserteq_int(strlen(t), 399);
+            asserteq_buf(t + 198, "a|a", 3);
+        }
+        it("Clear keeps the capacity") {
+            char *t = grrrs_from_string("ana are mere");
+
+            grrrs_clear(t);
+            t = grrrs_append_cstring(t, "pere");
+            defer(_grrrs_free(t));
+
+            asserteq_buf(t, "pere", 5);
+            asserteq_int(grrrs_len(t), 4);
+            asserteq_int(grrrs_cap(t), 12);
+        }
+    }
+
     subdesc(trim_left) {
         it("no matches to trim") {
             char *t = grrrs_from_string("ana");